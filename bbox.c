@@ -29,6 +29,7 @@ extern void xy_from_ip(unsigned int ip, unsigned *xp, unsigned *yp);
 extern int DEBUG;
 extern unsigned int addr_space_first_addr;
 extern unsigned int addr_space_last_addr;
+extern unsigned int curve_diagonal;
 
 
 
@@ -37,7 +38,7 @@ extern unsigned int addr_space_last_addr;
  * 'slash' netmask bits.
  * 
  * For square areas this is pretty easy.  We know how to find the point diagonally
- * opposite the first value (add 1010..1010). Its a little harder for
+ * opposite the first value (add curve_diagonal). Its a little harder for
  * rectangular areas, so I cheat a little and divide it into the two smaller
  * squares.
  */
@@ -45,7 +46,7 @@ bbox
 bbox_from_int_slash(unsigned int first, int slash)
 {
     bbox box;
-    unsigned int diag = 0xAAAAAAAA;
+    unsigned int diag = curve_diagonal;
     unsigned int x1 = 0, y1 = 0, x2 = 0, y2 = 0;
 
     if (slash > 31) {
@@ -32,7 +32,8 @@ cidr_parse(const char *cidr, unsigned int *rfirst, unsigned int *rlast, int *rsl
     int slash;
     unsigned int first;
     unsigned int last;
-    strncpy(cidr_copy, cidr, 24);
+    strncpy(cidr_copy, cidr, sizeof(cidr_copy) - 1);
+    cidr_copy[sizeof(cidr_copy) - 1] = '\0';
     t = strchr(cidr_copy, '/');
     if (NULL == t) {
 	warnx("missing / on CIDR '%s'\n", cidr_copy);
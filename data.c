@@ -0,0 +1,923 @@
+// glheatmap -- OpenGL-based interactive IPv4 heatmap
+//
+// Copyright (C) 2016 Verisign, Inc.
+//
+//  This file is part of glheatmap.
+//
+//  glheatmap is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  glheatmap is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with glheatmap  If not, see <http://www.gnu.org/licenses/>.
+//
+
+/*
+ * Counter storage.
+ *
+ * The trie backend is the original DATA: a 256-entry table per octet,
+ * with the last level pointing at pages, each a data_meta followed by its
+ * counters.  Each lookup is four dependent loads, but memory is only
+ * spent on the /24s seen.  Every table carries a 256-bit map of the slots
+ * in use, so that walks can visit just those, a word at a time.
+ *
+ * The flat backend is a single array indexed by address, reserved as a
+ * sparse anonymous mapping so that the kernel only supplies memory for
+ * the parts that are written.  Lookups are a single index.  Since it has
+ * no tables to test for emptiness, it keeps a bit per /24, /16 and /8
+ * that is set the first time anything under it is written, so the
+ * renderer and decay can still skip unused space.  Page metadata is a
+ * second sparse array, indexed by /24.
+ *
+ * Pages whose counters have all decayed away are given back by
+ * data_retire().  Flat pages just lose their flag, and the memory under
+ * them is returned to the kernel once every /24 sharing an OS page is
+ * gone.  Trie pages, and tables left empty, are unlinked and put in limbo
+ * until every thread that might still be looking at them has passed a
+ * quiescent state (data_quiescent() or data_offline()); only then do
+ * they go back to the arena.  A table being emptied first has each slot
+ * set to DATA_TOMB, so that no writer can hang a new page off it
+ * meanwhile; writers that see a tombstone start again from the root.
+ *
+ * Trie tables and pages come from an arena rather than calloc(): 2 MB
+ * slabs, aligned so that the kernel can back them with huge pages, carved
+ * into cache-line aligned objects of one size per class.  Keeping the trie
+ * in a few large mappings means fewer TLB misses on the renderer's and
+ * decay worker's walks, and a burst of new /24s costs a pointer bump
+ * each.  Slab memory starts out zero and data_reclaim() clears objects
+ * before putting them on the free list, so allocation never has to.
+ *
+ * Writers also mark each /24 they change in a second set of bitmaps, by
+ * /24, /16 and /8, which the renderer takes and clears every frame with
+ * data_changed(), so that it only has to look at what changed since.
+ *
+ * Integer cells are decayed with stochastic rounding: the scaled value is
+ * rounded up with probability equal to its fractional part.  Rounding to
+ * nearest would leave small counts stuck forever and truncating would
+ * drain them early; this way every cell fades at the right rate on
+ * average and the colors do not band.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <err.h>
+#include <pthread.h>
+#include <sys/mman.h>
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define HAVE_AVX2_KERNEL 1
+#endif
+#endif
+
+#include "data.h"
+
+#ifndef MAP_NORESERVE
+#define MAP_NORESERVE 0
+#endif
+
+typedef struct {
+    data_meta meta;
+    DATA_TYPE cells[256];
+} data_leaf;
+
+/*
+ * A trie level: pointers to the next level down, or to pages
+ */
+typedef struct {
+    uint64_t map[4];		/* slots in use */
+    void *slot[256];
+} data_table;
+
+#define DATA_TOMB ((void *)1)
+#define DATA_MAX_THREADS 128
+#define QS_OFFLINE UINT64_MAX
+#define ARENA_SLAB (2 << 20)
+#define ARENA_ALIGN 64
+
+/*
+ * Free objects of one size class
+ */
+typedef struct arena_obj {
+    struct arena_obj *next;
+} arena_obj;
+
+typedef struct {
+    size_t size;
+    char *next;			/* unused part of the current slab */
+    char *end;
+    arena_obj *free;
+    pthread_mutex_t mutex;
+} arena;
+
+/*
+ * Something unlinked from the trie, waiting to be freed
+ */
+typedef struct limbo {
+    struct limbo *next;
+    void *p;
+    arena *arena;
+    uint64_t epoch;		/* free once every thread has seen this */
+} limbo;
+
+static arena ARENA_TABLE = {(sizeof(data_table) + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1), 0, 0, 0, PTHREAD_MUTEX_INITIALIZER};
+static arena ARENA_LEAF = {(sizeof(data_leaf) + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1), 0, 0, 0, PTHREAD_MUTEX_INITIALIZER};
+
+static data_table *DATA = 0;
+DATA_TYPE *DATA_CELLS = 0;
+data_meta *DATA_META = 0;
+uint64_t *DATA_PAGES = 0;
+static uint64_t DATA_PAGES16[1 << 10];
+static uint64_t DATA_PAGES8[4];
+static uint64_t *DIRTY = 0;		/* a bit per /24 changed since taken */
+static uint64_t DIRTY16[1 << 10];
+static uint64_t DIRTY8[4];
+static unsigned long DATA_NPAGES = 0;
+static size_t DATA_BYTES = 0;
+static unsigned int FLAT_SPAN = 1;	/* /24s per OS page, flat backend */
+static limbo *LIMBO = 0;
+static pthread_mutex_t mutexLimbo = PTHREAD_MUTEX_INITIALIZER;
+static uint64_t QS_EPOCH = 1;
+static uint64_t QS_SEEN[DATA_MAX_THREADS];
+static unsigned int QS_NSLOTS = 0;
+static __thread int qs_slot = -1;
+
+static void scale_init(void);
+
+static void *
+map_sparse(size_t len)
+{
+    void *p = mmap(0, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (MAP_FAILED == p)
+	err(1, "mmap %zu bytes for flat storage", len);
+    return p;
+}
+
+void
+data_init(int backend)
+{
+    scale_init();
+    DIRTY = map_sparse(1 << 21);
+    if (DATA_FLAT == backend) {
+	if (sizeof(size_t) < 8)
+	    errx(1, "flat storage needs a 64-bit address space");
+	DATA_CELLS = map_sparse(sizeof(DATA_TYPE) << 32);
+	DATA_META = map_sparse(sizeof(data_meta) << 24);
+	DATA_PAGES = map_sparse(1 << 21);
+	FLAT_SPAN = sysconf(_SC_PAGESIZE) / (256 * sizeof(DATA_TYPE));
+	if (FLAT_SPAN < 1)
+	    FLAT_SPAN = 1;
+    } else {
+	DATA = calloc(1, sizeof(*DATA));
+	if (0 == DATA)
+	    err(1, "calloc");
+    }
+}
+
+/*
+ * A zeroed object from arena 'a'
+ */
+static void *
+arena_get(arena *a)
+{
+    void *p;
+    pthread_mutex_lock(&a->mutex);
+    if (a->free) {
+	p = a->free;
+	a->free = a->free->next;
+	((arena_obj *)p)->next = 0;
+    } else {
+	if (a->next + a->size > a->end) {
+	    /* map twice the slab so an aligned one fits inside */
+	    char *m = mmap(0, 2 * ARENA_SLAB, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	    char *slab;
+	    if (MAP_FAILED == m)
+		err(1, "mmap %d bytes for trie", 2 * ARENA_SLAB);
+	    slab = (char *)(((uintptr_t)m + ARENA_SLAB - 1) & ~(uintptr_t)(ARENA_SLAB - 1));
+	    if (slab > m)
+		munmap(m, slab - m);
+	    munmap(slab + ARENA_SLAB, m + ARENA_SLAB - slab);
+#ifdef MADV_HUGEPAGE
+	    madvise(slab, ARENA_SLAB, MADV_HUGEPAGE);
+#endif
+	    a->next = slab;
+	    a->end = slab + ARENA_SLAB;
+	}
+	p = a->next;
+	a->next += a->size;
+    }
+    pthread_mutex_unlock(&a->mutex);
+    return p;
+}
+
+/*
+ * Return a zeroed object to arena 'a'
+ */
+static void
+arena_put(arena *a, void *p)
+{
+    pthread_mutex_lock(&a->mutex);
+    ((arena_obj *)p)->next = a->free;
+    a->free = p;
+    pthread_mutex_unlock(&a->mutex);
+}
+
+/*
+ * Return the table (or page) from arena 'a' in slot 'k' of 't',
+ * allocating it if necessary.  New tables are published with
+ * compare-and-swap so that any number of reader threads can grow the
+ * trie without a lock; the loser of a race returns its table and uses the
+ * winner's.  Returns DATA_TOMB if 't' is being freed.
+ */
+static void *
+table_get(data_table *t, unsigned int k, arena *a, int pages)
+{
+    void *p = __atomic_load_n(t->slot + k, __ATOMIC_ACQUIRE);
+    void *n;
+    if (p)
+	return p;
+    n = arena_get(a);
+    if (!__atomic_compare_exchange_n(t->slot + k, &p, n, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+	arena_put(a, n);
+	return p;
+    }
+    __atomic_fetch_or(t->map + (k >> 6), 1ull << (k & 63), __ATOMIC_RELEASE);
+    __atomic_add_fetch(&DATA_BYTES, a->size, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&DATA_NPAGES, pages, __ATOMIC_RELAXED);
+    return n;
+}
+
+/*
+ * Unlink slot 'k' of 't'.  The map bit goes first: a writer can only
+ * refill the slot, and set the bit again, once it reads as empty.
+ */
+static void
+table_clear(data_table *t, unsigned int k)
+{
+    __atomic_fetch_and(t->map + (k >> 6), ~(1ull << (k & 63)), __ATOMIC_RELAXED);
+    __atomic_store_n(t->slot + k, 0, __ATOMIC_RELEASE);
+}
+
+/*
+ * Return slot 'k' of 't', or 0 if it is empty or being freed
+ */
+static inline void *
+table_peek(data_table *t, unsigned int k)
+{
+    void *p = __atomic_load_n(t->slot + k, __ATOMIC_ACQUIRE);
+    return DATA_TOMB == p ? 0 : p;
+}
+
+DATA_TYPE *
+data_trie_ptr(unsigned int i, data_meta **meta)
+{
+    data_table *B;
+    data_table *C;
+    data_leaf *D;
+    for (;;) {
+	B = table_get(DATA, i >> 24, &ARENA_TABLE, 0);
+	if (DATA_TOMB == (C = table_get(B, (i >> 16) & 0xFF, &ARENA_TABLE, 0)))
+	    continue;
+	if (DATA_TOMB == (D = table_get(C, (i >> 8) & 0xFF, &ARENA_LEAF, 1)))
+	    continue;
+	*meta = &D->meta;
+	return D->cells + (i & 0xFF);
+    }
+}
+
+/*
+ * First write under a /24 in the flat backend, or the first since it was
+ * retired.  data_ptr() tests the /24's bit without the page lock, so
+ * several writers may get here for one page: only the one whose
+ * fetch_or sets the bit counts the page.  The /16 and /8 bits are set
+ * first, so that a reader never finds a /24 without its parents.  The
+ * page lock keeps data_retire(), which clears the bits with it held,
+ * from retiring the page between the bit being set and 'dead' cleared.
+ */
+void
+data_flat_touch(unsigned int i)
+{
+    data_meta *m = DATA_META + (i >> 8);
+    uint64_t b = 1ull << ((i >> 8) & 63);
+    __atomic_fetch_or(DATA_PAGES8 + (i >> 30), 1ull << ((i >> 24) & 63), __ATOMIC_RELAXED);
+    __atomic_fetch_or(DATA_PAGES16 + (i >> 22), 1ull << ((i >> 16) & 63), __ATOMIC_RELAXED);
+    data_lock(m);
+    if (0 == (__atomic_fetch_or(DATA_PAGES + (i >> 14), b, __ATOMIC_RELEASE) & b)) {
+	m->dead = 0;
+	__atomic_add_fetch(&DATA_NPAGES, 1, __ATOMIC_RELAXED);
+    }
+    data_unlock(m);
+}
+
+/*
+ * Fill 'map' with a bit for each child of i/prefixlen, for prefixlen 0,
+ * 8 or 16, that has anything stored under it.  Returns 0 if none has.
+ * Used to visit just the occupied parts of the address space.
+ */
+int
+data_children(unsigned int i, int prefixlen, uint64_t map[4])
+{
+    const uint64_t *m;
+    data_table *t = DATA;
+    if (DATA_CELLS) {
+	if (0 == prefixlen)
+	    m = DATA_PAGES8;
+	else if (8 == prefixlen)
+	    m = DATA_PAGES16 + ((i >> 24) << 2);
+	else
+	    m = DATA_PAGES + ((i >> 16) << 2);
+    } else {
+	if (prefixlen >= 8 && t)
+	    t = table_peek(t, i >> 24);
+	if (prefixlen >= 16 && t)
+	    t = table_peek(t, (i >> 16) & 0xFF);
+	if (0 == t) {
+	    memset(map, 0, 4 * sizeof(*map));
+	    return 0;
+	}
+	m = t->map;
+    }
+    map[0] = __atomic_load_n(m + 0, __ATOMIC_ACQUIRE);
+    map[1] = __atomic_load_n(m + 1, __ATOMIC_ACQUIRE);
+    map[2] = __atomic_load_n(m + 2, __ATOMIC_ACQUIRE);
+    map[3] = __atomic_load_n(m + 3, __ATOMIC_ACQUIRE);
+    return 0 != (map[0] | map[1] | map[2] | map[3]);
+}
+
+/*
+ * Mark the /24 containing 'i' as changed, after writing to it with its
+ * lock held.  A full fence orders the write before the bits are looked
+ * at, so a writer that finds a bit set knows the reader has yet to take
+ * it, and will copy the page after the write.  Like the /16 and /8 bits,
+ * which every writer shares, the /24's is only written when clear, so
+ * writers to a busy /24 do not keep taking its cache line from the
+ * reader and each other.
+ */
+void
+data_dirty(unsigned int i)
+{
+    uint64_t b24 = 1ull << ((i >> 8) & 63);
+    uint64_t b16 = 1ull << ((i >> 16) & 63);
+    uint64_t b8 = 1ull << ((i >> 24) & 63);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (0 == (__atomic_load_n(DIRTY + (i >> 14), __ATOMIC_SEQ_CST) & b24))
+	__atomic_fetch_or(DIRTY + (i >> 14), b24, __ATOMIC_SEQ_CST);
+    if (0 == (__atomic_load_n(DIRTY16 + (i >> 22), __ATOMIC_SEQ_CST) & b16))
+	__atomic_fetch_or(DIRTY16 + (i >> 22), b16, __ATOMIC_SEQ_CST);
+    if (0 == (__atomic_load_n(DIRTY8 + (i >> 30), __ATOMIC_SEQ_CST) & b8))
+	__atomic_fetch_or(DIRTY8 + (i >> 30), b8, __ATOMIC_SEQ_CST);
+}
+
+/*
+ * Mark every /24 with anything stored as changed, for when whatever the
+ * renderer has kept must be worked out again.  The caller must be online.
+ */
+void
+data_dirty_all(void)
+{
+    uint64_t slash8[4], slash16[4], slash24[4];
+    unsigned int a, b, c;
+    data_children(0, 0, slash8);
+    DATA_FOREACH(slash8, a) {
+	data_children(a << 24, 8, slash16);
+	DATA_FOREACH(slash16, b) {
+	    data_children((a << 24) | (b << 16), 16, slash24);
+	    DATA_FOREACH(slash24, c)
+		data_dirty((a << 24) | (b << 16) | (c << 8));
+	}
+    }
+}
+
+/*
+ * Like data_children(), but for the children of i/prefixlen marked by
+ * data_dirty() since the last call, whose marks are cleared.  Only one
+ * thread may take marks, and must take a prefix's before its children's.
+ */
+int
+data_changed(unsigned int i, int prefixlen, uint64_t map[4])
+{
+    uint64_t *m;
+    int w;
+    if (0 == prefixlen)
+	m = DIRTY8;
+    else if (8 == prefixlen)
+	m = DIRTY16 + ((i >> 24) << 2);
+    else
+	m = DIRTY + ((i >> 16) << 2);
+    for (w = 0; w < 4; w++)
+	map[w] = __atomic_load_n(m + w, __ATOMIC_SEQ_CST) ? __atomic_exchange_n(m + w, 0, __ATOMIC_SEQ_CST) : 0;
+    return 0 != (map[0] | map[1] | map[2] | map[3]);
+}
+
+/*
+ * Return the 256 counters of the /24 containing 'i', or 0 if nothing
+ * has been stored there.  The page's metadata is returned in *meta if
+ * 'meta' is not null.
+ */
+DATA_TYPE *
+data_page(unsigned int i, data_meta **meta)
+{
+    data_table *B;
+    data_table *C;
+    data_leaf *D;
+    if (DATA_CELLS) {
+	if (0 == (__atomic_load_n(DATA_PAGES + (i >> 14), __ATOMIC_RELAXED) & (1ull << ((i >> 8) & 63))))
+	    return 0;
+	if (meta)
+	    *meta = DATA_META + (i >> 8);
+	return DATA_CELLS + (i & ~0xFFu);
+    }
+    if (0 == (B = table_peek(DATA, i >> 24)))
+	return 0;
+    if (0 == (C = table_peek(B, (i >> 16) & 0xFF)))
+	return 0;
+    if (0 == (D = table_peek(C, (i >> 8) & 0xFF)))
+	return 0;
+    if (meta)
+	*meta = &D->meta;
+    return D->cells;
+}
+
+static __thread uint32_t dither = 2463534242u;	/* xorshift32 state */
+
+static inline uint32_t
+dither_next(void)
+{
+    uint32_t x = dither;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return dither = x;
+}
+
+/*
+ * Page scaling kernels.  Integer cells are multiplied by a 0.16 fixed
+ * point factor 'm' with a random 16-bit dither added below the binary
+ * point; double cells are simply multiplied.  Each returns nonzero if
+ * any cell is still nonzero afterwards.  The SSE2 and AVX2 versions do
+ * the 16x16->32 bit multiply as mulhi/mullo, turning the carry out of
+ * mullo + dither into the rounding up, and run one xorshift32 per
+ * 32-bit lane for the dither.
+ */
+#if DATA_CELL_BITS == 64
+typedef double scale_t;
+#else
+typedef uint32_t scale_t;
+#endif
+
+/*
+ * The portable kernel.  Built everywhere, though only used where there
+ * is no SSE2, so that the tests can check the others against it.
+ */
+__attribute__((unused)) static int
+scale_generic(DATA_TYPE *D, scale_t m)
+{
+    DATA_TYPE any = 0;
+    int i;
+    for (i = 0; i < 256; i++) {
+	if (0 == D[i])
+	    continue;
+#if DATA_CELL_BITS == 64
+	D[i] *= m;
+#else
+	D[i] = (D[i] * m + (dither_next() & 0xFFFF)) >> 16;
+#endif
+	any = any || D[i];
+    }
+    return 0 != any;
+}
+
+#if defined(__SSE2__)
+#if DATA_CELL_BITS != 64
+static __thread uint32_t ditherv[8] = {
+    2463534242u, 1812433253u, 3624381080u, 2714350102u,
+    1597334677u, 3812015801u, 1146398069u, 2961193841u
+};
+#endif
+
+static inline __m128i
+xorshift_sse2(__m128i x)
+{
+    x = _mm_xor_si128(x, _mm_slli_epi32(x, 13));
+    x = _mm_xor_si128(x, _mm_srli_epi32(x, 17));
+    return _mm_xor_si128(x, _mm_slli_epi32(x, 5));
+}
+
+#if DATA_CELL_BITS != 64
+static inline __m128i
+scale16_sse2(__m128i v, __m128i m, __m128i r)
+{
+    const __m128i flip = _mm_set1_epi16(0x7FFF);
+    const __m128i bias = _mm_set1_epi16((short)0x8000);
+    __m128i lo = _mm_mullo_epi16(v, m);
+    __m128i hi = _mm_mulhi_epu16(v, m);
+    /* carry iff lo + r > 0xFFFF, i.e. lo > ~r, compared unsigned */
+    __m128i c = _mm_cmpgt_epi16(_mm_xor_si128(lo, bias), _mm_xor_si128(r, flip));
+    return _mm_sub_epi16(hi, c);
+}
+#endif
+
+static int
+scale_sse2(DATA_TYPE *D, scale_t m)
+{
+    __m128i any = _mm_setzero_si128();
+    int i;
+#if DATA_CELL_BITS == 64
+    const __m128d f = _mm_set1_pd(m);
+    for (i = 0; i < 256; i += 2) {
+	__m128d v = _mm_mul_pd(_mm_loadu_pd(D + i), f);
+	_mm_storeu_pd(D + i, v);
+	any = _mm_or_si128(any, _mm_castpd_si128(v));
+    }
+#else
+    const __m128i mm = _mm_set1_epi16((short)m);
+    __m128i r = _mm_loadu_si128((const __m128i *)ditherv);
+#if DATA_CELL_BITS == 16
+    for (i = 0; i < 256; i += 8) {
+	__m128i v = _mm_loadu_si128((const __m128i *)(D + i));
+	r = xorshift_sse2(r);
+	v = scale16_sse2(v, mm, r);
+	_mm_storeu_si128((__m128i *)(D + i), v);
+	any = _mm_or_si128(any, v);
+    }
+#else
+    const __m128i zero = _mm_setzero_si128();
+    for (i = 0; i < 256; i += 16) {
+	__m128i v = _mm_loadu_si128((const __m128i *)(D + i));
+	__m128i l;
+	__m128i h;
+	r = xorshift_sse2(r);
+	l = scale16_sse2(_mm_unpacklo_epi8(v, zero), mm, r);
+	r = xorshift_sse2(r);
+	h = scale16_sse2(_mm_unpackhi_epi8(v, zero), mm, r);
+	v = _mm_packus_epi16(l, h);
+	_mm_storeu_si128((__m128i *)(D + i), v);
+	any = _mm_or_si128(any, v);
+    }
+#endif
+    _mm_storeu_si128((__m128i *)ditherv, r);
+#endif
+    return 0xFFFF != _mm_movemask_epi8(_mm_cmpeq_epi8(any, _mm_setzero_si128()));
+}
+
+#if HAVE_AVX2_KERNEL
+__attribute__((target("avx2"))) static inline __m256i
+xorshift_avx2(__m256i x)
+{
+    x = _mm256_xor_si256(x, _mm256_slli_epi32(x, 13));
+    x = _mm256_xor_si256(x, _mm256_srli_epi32(x, 17));
+    return _mm256_xor_si256(x, _mm256_slli_epi32(x, 5));
+}
+
+#if DATA_CELL_BITS != 64
+__attribute__((target("avx2"))) static inline __m256i
+scale16_avx2(__m256i v, __m256i m, __m256i r)
+{
+    const __m256i flip = _mm256_set1_epi16(0x7FFF);
+    const __m256i bias = _mm256_set1_epi16((short)0x8000);
+    __m256i lo = _mm256_mullo_epi16(v, m);
+    __m256i hi = _mm256_mulhi_epu16(v, m);
+    __m256i c = _mm256_cmpgt_epi16(_mm256_xor_si256(lo, bias), _mm256_xor_si256(r, flip));
+    return _mm256_sub_epi16(hi, c);
+}
+#endif
+
+__attribute__((target("avx2"))) static int
+scale_avx2(DATA_TYPE *D, scale_t m)
+{
+    __m256i any = _mm256_setzero_si256();
+    int i;
+#if DATA_CELL_BITS == 64
+    const __m256d f = _mm256_set1_pd(m);
+    for (i = 0; i < 256; i += 4) {
+	__m256d v = _mm256_mul_pd(_mm256_loadu_pd(D + i), f);
+	_mm256_storeu_pd(D + i, v);
+	any = _mm256_or_si256(any, _mm256_castpd_si256(v));
+    }
+#else
+    const __m256i mm = _mm256_set1_epi16((short)m);
+    __m256i r = _mm256_loadu_si256((const __m256i *)ditherv);
+#if DATA_CELL_BITS == 16
+    for (i = 0; i < 256; i += 16) {
+	__m256i v = _mm256_loadu_si256((const __m256i *)(D + i));
+	r = xorshift_avx2(r);
+	v = scale16_avx2(v, mm, r);
+	_mm256_storeu_si256((__m256i *)(D + i), v);
+	any = _mm256_or_si256(any, v);
+    }
+#else
+    for (i = 0; i < 256; i += 32) {
+	__m256i v = _mm256_loadu_si256((const __m256i *)(D + i));
+	__m256i l;
+	__m256i h;
+	r = xorshift_avx2(r);
+	/* unpack and pack both work per 128-bit lane, so order is kept */
+	l = scale16_avx2(_mm256_unpacklo_epi8(v, _mm256_setzero_si256()), mm, r);
+	r = xorshift_avx2(r);
+	h = scale16_avx2(_mm256_unpackhi_epi8(v, _mm256_setzero_si256()), mm, r);
+	v = _mm256_packus_epi16(l, h);
+	_mm256_storeu_si256((__m256i *)(D + i), v);
+	any = _mm256_or_si256(any, v);
+    }
+#endif
+    _mm256_storeu_si256((__m256i *)ditherv, r);
+#endif
+    return !_mm256_testz_si256(any, any);
+}
+#endif
+#endif
+
+static int (*scale_kernel)(DATA_TYPE *, scale_t) =
+#if defined(__SSE2__)
+    scale_sse2;
+#else
+    scale_generic;
+#endif
+
+/*
+ * Use the widest kernel the CPU supports
+ */
+static void
+scale_init(void)
+{
+#if HAVE_AVX2_KERNEL
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+	scale_kernel = scale_avx2;
+#endif
+}
+
+/*
+ * Multiply the 256 counters of a page by 'f', which is at most 1.
+ * Returns 0 if that leaves the whole page zero.
+ */
+int
+data_scale(DATA_TYPE *D, double f)
+{
+#if DATA_CELL_BITS == 64
+    return scale_kernel(D, f);
+#else
+    uint32_t m = f * 65536.0 + 0.5;	/* 0.16 fixed point */
+    if (m > 0xFFFF)
+	return 1;
+    return scale_kernel(D, m);
+#endif
+}
+
+/*
+ * Round 'x' cell units to a whole number of them, stochastically, so
+ * that fractional increments add up correctly on average
+ */
+double
+data_round(double x)
+{
+#if DATA_CELL_BITS == 64
+    return x;
+#else
+    double i = (uint32_t)x;
+    if ((dither_next() & 0xFFFF) < (x - i) * 65536.0)
+	i += 1.0;
+    return i;
+#endif
+}
+
+/*
+ * Scale a page by 'f' and restamp it, with its lock held.  The page's
+ * sequence number is odd for the duration, so that data_read() can tell
+ * a page it copied was changed under it.
+ */
+void
+data_rescale(DATA_TYPE *D, data_meta *m, double f, double stamp)
+{
+    int w;
+    __atomic_store_n(&m->seq, m->seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    m->live = data_scale(D, f);
+    for (w = 0; w < 4; w++) {
+	uint64_t b = m->map[w];
+	uint64_t r;
+	/* drop the cells that rounded down to zero */
+	for (r = m->live ? b : 0; r; r &= r - 1)
+	    if (0 == D[w * 64 + __builtin_ctzll(r)])
+		b &= ~(r & -r);
+	if (!m->live)
+	    b = 0;
+	__atomic_store_n(m->map + w, b, __ATOMIC_RELAXED);
+    }
+    m->stamp = stamp;
+    __atomic_store_n(&m->seq, m->seq + 1, __ATOMIC_RELEASE);
+}
+
+/*
+ * Copy a page's cells, cell map and stamp as of a single point between
+ * rescales.  Increments landing during the copy may or may not be seen,
+ * which is fine; what matters is never pairing cells with the wrong
+ * stamp.
+ */
+void
+data_read(const DATA_TYPE *D, data_meta *m, DATA_TYPE *copy, uint64_t map[4], double *stamp)
+{
+    uint32_t seq;
+    int w;
+    do {
+	while ((seq = __atomic_load_n(&m->seq, __ATOMIC_ACQUIRE)) & 1)
+	    ;
+	*stamp = m->stamp;
+	for (w = 0; w < 4; w++)
+	    map[w] = __atomic_load_n(m->map + w, __ATOMIC_RELAXED);
+	memcpy(copy, D, 256 * sizeof(*D));
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+    } while (seq != __atomic_load_n(&m->seq, __ATOMIC_RELAXED));
+}
+
+/*
+ * Quiescent-state tracking for page reclamation.  Each thread that
+ * touches DATA has a slot holding the last epoch it saw while holding no
+ * page pointers, or QS_OFFLINE while it is not looking at all.  Anything
+ * retired before an epoch can be freed once every slot has reached it.
+ */
+static void
+qs_announce(uint64_t v)
+{
+    if (qs_slot < 0) {
+	qs_slot = __atomic_fetch_add(&QS_NSLOTS, 1, __ATOMIC_ACQ_REL);
+	if (qs_slot >= DATA_MAX_THREADS)
+	    errx(1, "too many threads for page reclamation (max %d)", DATA_MAX_THREADS);
+    }
+    __atomic_store_n(QS_SEEN + qs_slot, v, __ATOMIC_SEQ_CST);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+
+/*
+ * Called by a thread between uses of page pointers.  It must not keep
+ * any across the call.  Writers call this for every record, so it only
+ * stores when the epoch has moved, rather than keep taking the cache
+ * line that data_reclaim() reads.
+ */
+void
+data_quiescent(void)
+{
+    uint64_t e = __atomic_load_n(&QS_EPOCH, __ATOMIC_ACQUIRE);
+    if (qs_slot < 0 || QS_OFFLINE == QS_SEEN[qs_slot])
+	qs_announce(e);
+    else if (e != QS_SEEN[qs_slot])
+	__atomic_store_n(QS_SEEN + qs_slot, e, __ATOMIC_RELEASE);
+}
+
+/*
+ * Called by a thread before it blocks or exits, so that reclamation does
+ * not wait for it.  Its next data_quiescent() brings it back.
+ */
+void
+data_offline(void)
+{
+    if (qs_slot >= 0)
+	__atomic_store_n(QS_SEEN + qs_slot, QS_OFFLINE, __ATOMIC_RELEASE);
+}
+
+/*
+ * Put 'p' in limbo.  The decay sweep may retire pages from several
+ * threads at once.
+ */
+static void
+limbo_add(void *p, arena *a)
+{
+    limbo *l = malloc(sizeof(*l));
+    if (0 == l)
+	err(1, "malloc");
+    l->p = p;
+    l->arena = a;
+    l->epoch = __atomic_load_n(&QS_EPOCH, __ATOMIC_RELAXED) + 1;
+    pthread_mutex_lock(&mutexLimbo);
+    l->next = LIMBO;
+    LIMBO = l;
+    pthread_mutex_unlock(&mutexLimbo);
+}
+
+/*
+ * Claim every slot of what looks like an empty table by setting it to
+ * DATA_TOMB, so that no writer can add to it while it is unlinked.
+ * Returns 0, leaving the table as it was, if any slot is in use.
+ */
+static int
+table_vacate(data_table *t)
+{
+    int i;
+    int j;
+    if (t->map[0] | t->map[1] | t->map[2] | t->map[3])
+	return 0;
+    for (i = 0; i < 256; i++) {
+	void *e = 0;
+	if (!__atomic_compare_exchange_n(t->slot + i, &e, DATA_TOMB, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+	    for (j = 0; j < i; j++)
+		__atomic_store_n(t->slot + j, 0, __ATOMIC_RELEASE);
+	    return 0;
+	}
+    }
+    return 1;
+}
+
+/*
+ * Give back the /24 containing 'i', whose counters are all zero.  Only
+ * the decay worker calls this, with the page's lock held; a writer that
+ * was waiting for the lock sees 'dead' and looks the page up again.
+ */
+void
+data_retire(unsigned int i, data_meta *m)
+{
+    data_table *B;
+    data_table *C;
+    data_leaf *D;
+    m->dead = 1;
+    __atomic_sub_fetch(&DATA_NPAGES, 1, __ATOMIC_RELAXED);
+    if (DATA_CELLS) {
+	unsigned int first = (i >> 8) & ~(FLAT_SPAN - 1);
+	unsigned int n;
+	int vacant = 1;
+	__atomic_fetch_and(DATA_PAGES + (i >> 14), ~(1ull << ((i >> 8) & 63)), __ATOMIC_RELEASE);
+	/*
+	 * The memory can go back once no /24 sharing its OS page is in
+	 * use.  Holding their locks means a writer that brings one back
+	 * writes after the madvise(), into a fresh zero page.
+	 */
+	for (n = first; n < first + FLAT_SPAN; n++)
+	    if (n != i >> 8)
+		data_lock(DATA_META + n);
+	for (n = first; n < first + FLAT_SPAN; n++)
+	    if (__atomic_load_n(DATA_PAGES + (n >> 6), __ATOMIC_RELAXED) & (1ull << (n & 63)))
+		vacant = 0;
+	if (vacant)
+	    madvise(DATA_CELLS + ((size_t)first << 8), FLAT_SPAN * 256 * sizeof(DATA_TYPE), MADV_DONTNEED);
+	for (n = first; n < first + FLAT_SPAN; n++)
+	    if (n != i >> 8)
+		data_unlock(DATA_META + n);
+	return;
+    }
+    B = DATA->slot[i >> 24];
+    C = B->slot[(i >> 16) & 0xFF];
+    D = C->slot[(i >> 8) & 0xFF];
+    table_clear(C, (i >> 8) & 0xFF);
+    limbo_add(D, &ARENA_LEAF);
+    if (!table_vacate(C))
+	return;
+    table_clear(B, (i >> 16) & 0xFF);
+    limbo_add(C, &ARENA_TABLE);
+    if (!table_vacate(B))
+	return;
+    table_clear(DATA, i >> 24);
+    limbo_add(B, &ARENA_TABLE);
+}
+
+/*
+ * Called by the decay worker after each pass: start a new epoch, and
+ * return to the arena whatever every thread has been quiescent since
+ * retiring
+ */
+void
+data_reclaim(void)
+{
+    uint64_t min = __atomic_add_fetch(&QS_EPOCH, 1, __ATOMIC_SEQ_CST);
+    unsigned int n = __atomic_load_n(&QS_NSLOTS, __ATOMIC_ACQUIRE);
+    unsigned int k;
+    limbo **lp;
+    for (k = 0; k < n && k < DATA_MAX_THREADS; k++) {
+	uint64_t seen = __atomic_load_n(QS_SEEN + k, __ATOMIC_ACQUIRE);
+	if (seen < min)
+	    min = seen;
+    }
+    pthread_mutex_lock(&mutexLimbo);
+    for (lp = &LIMBO; *lp;) {
+	limbo *l = *lp;
+	if (l->epoch > min) {
+	    lp = &l->next;
+	    continue;
+	}
+	*lp = l->next;
+	__atomic_sub_fetch(&DATA_BYTES, l->arena->size, __ATOMIC_RELAXED);
+	memset(l->p, 0, l->arena->size);
+	arena_put(l->arena, l->p);
+	free(l);
+    }
+    pthread_mutex_unlock(&mutexLimbo);
+}
+
+/*
+ * Pages in use, and roughly how much memory they and the trie take
+ */
+void
+data_stats(unsigned long *pages, size_t *bytes)
+{
+    *pages = __atomic_load_n(&DATA_NPAGES, __ATOMIC_RELAXED);
+    if (DATA_CELLS)
+	*bytes = *pages * (256 * sizeof(DATA_TYPE) + sizeof(data_meta));
+    else
+	*bytes = __atomic_load_n(&DATA_BYTES, __ATOMIC_RELAXED);
+}
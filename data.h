@@ -0,0 +1,134 @@
+#ifndef DATA_H
+#define DATA_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+ * Compile-time options.  DATA_CELL_BITS picks the counter cell: 8 for a
+ * whole count in a byte, 16 for 9.7 fixed point, or 64 for a double.
+ * Counters saturate at 255 whichever is used.  Cells hold up to twice
+ * that, since a page's cells are only rescaled once per half-life (see
+ * page_catch_up()); 8-bit cells have no such headroom and may saturate
+ * early until their page is next rescaled.
+ */
+#ifndef DATA_CELL_BITS
+#define DATA_CELL_BITS 16
+#endif
+
+#if DATA_CELL_BITS == 64
+#define DATA_TYPE double
+#define DATA_ONE 1.0
+#define DATA_CELL_MAX 512.0
+#elif DATA_CELL_BITS == 16
+#define DATA_TYPE uint16_t
+#define DATA_ONE 128
+#define DATA_CELL_MAX 0xFFFF
+#elif DATA_CELL_BITS == 8
+#define DATA_TYPE uint8_t
+#define DATA_ONE 1
+#define DATA_CELL_MAX 0xFF
+#else
+#error "DATA_CELL_BITS must be 8, 16 or 64"
+#endif
+
+#define DATA_MAX (255 * DATA_ONE)
+#define DATA_VALUE(v) ((double)(v) / DATA_ONE)
+
+/*
+ * Storage backends for the per-address counters.  Either way the counters
+ * for a /24 are 256 consecutive cells (a "page") that can be found with
+ * data_page(), and each page has a data_meta.
+ */
+#define DATA_TRIE 0		/* 4-level table of pages, allocated as touched */
+#define DATA_FLAT 1		/* one 2^32-cell array in a sparse mapping */
+
+typedef struct {
+    double stamp;		/* file time the cells have been decayed to */
+    uint32_t seq;		/* odd while the page is being rescaled */
+    uint8_t live;		/* zero if every cell is known to be zero */
+    uint8_t lock;		/* held while writing to the page */
+    uint8_t dead;		/* retired; look the page up again */
+    uint64_t map[4];		/* cells that may be nonzero */
+} data_meta;
+
+extern DATA_TYPE *DATA_CELLS;	/* flat backend, else 0 */
+extern data_meta *DATA_META;	/* flat backend: one per /24 */
+extern uint64_t *DATA_PAGES;	/* flat backend: a bit for each /24 written */
+
+void data_init(int backend);
+DATA_TYPE *data_trie_ptr(unsigned int i, data_meta **meta);
+void data_flat_touch(unsigned int i);
+int data_children(unsigned int i, int prefixlen, uint64_t map[4]);
+void data_dirty(unsigned int i);
+void data_dirty_all(void);
+int data_changed(unsigned int i, int prefixlen, uint64_t map[4]);
+DATA_TYPE *data_page(unsigned int i, data_meta **meta);
+int data_scale(DATA_TYPE *page, double f);
+double data_round(double x);
+void data_rescale(DATA_TYPE *page, data_meta *meta, double f, double stamp);
+void data_read(const DATA_TYPE *page, data_meta *meta, DATA_TYPE *copy, uint64_t map[4], double *stamp);
+void data_retire(unsigned int i, data_meta *meta);
+void data_reclaim(void);
+void data_quiescent(void);
+void data_offline(void);
+void data_stats(unsigned long *pages, size_t *bytes);
+
+/*
+ * Run the statement that follows for each bit set in the 256-bit 'map'
+ * (from data_children(), data_changed() or a data_meta), with 'k' set to
+ * its index.  'continue' works as usual but 'break' does not leave the
+ * loop.
+ */
+#define DATA_FOREACH(map, k) \
+    for (unsigned int _w = 0; _w < 4; _w++) \
+	for (uint64_t _m = (map)[_w]; _m && ((k) = _w * 64 + __builtin_ctzll(_m), 1); _m &= _m - 1)
+
+/*
+ * Note that cell 'k' of a page may be nonzero, with the page locked
+ */
+static inline void
+data_mark(data_meta *m, unsigned int k)
+{
+    uint64_t b = __atomic_load_n(m->map + (k >> 6), __ATOMIC_RELAXED);
+    if (0 == (b & (1ull << (k & 63))))
+	__atomic_store_n(m->map + (k >> 6), b | (1ull << (k & 63)), __ATOMIC_RELAXED);
+}
+
+/*
+ * Writers (the ingest threads and the decay worker) hold a page's lock
+ * while they change it.  It is almost never contended, since each /8 has
+ * only one ingest thread.
+ */
+static inline void
+data_lock(data_meta *m)
+{
+    while (__atomic_exchange_n(&m->lock, 1, __ATOMIC_ACQUIRE))
+	while (__atomic_load_n(&m->lock, __ATOMIC_RELAXED))
+	    ;
+}
+
+static inline void
+data_unlock(data_meta *m)
+{
+    __atomic_store_n(&m->lock, 0, __ATOMIC_RELEASE);
+}
+
+/*
+ * Return the counter for address 'i', creating it if necessary.  The
+ * metadata of its page is returned in *meta.  Inline so that the flat
+ * backend costs one flag test and an index on the ingest path.
+ */
+static inline DATA_TYPE *
+data_ptr(unsigned int i, data_meta **meta)
+{
+    if (DATA_CELLS) {
+	if (0 == (__atomic_load_n(DATA_PAGES + (i >> 14), __ATOMIC_RELAXED) & (1ull << ((i >> 8) & 63))))
+	    data_flat_touch(i);
+	*meta = DATA_META + (i >> 8);
+	return DATA_CELLS + i;
+    }
+    return data_trie_ptr(i, meta);
+}
+
+#endif
@@ -23,7 +23,9 @@
 //
 //
 
+#define _GNU_SOURCE		/* recvmmsg() */
 #include <stdlib.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <unistd.h>
 #include <string.h>
@@ -42,6 +44,9 @@
 #include <stdarg.h>
 #include <fcntl.h>
 #include <sys/errno.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <poll.h>
 #include <pthread.h>
 
 
@@ -53,13 +58,12 @@
 #include <GLUT/glut.h>
 #endif
 
-#include "hue2rgb.h"
 #include "bbox.h"
-
-/*
- * Compile-time options
- */
-#define DATA_DOUBLES 1
+#include "parse.h"
+#include "pcap.h"
+#include "data.h"
+#include "points.h"
+#include "tiles.h"
 
 /*
  * Preprocessor macros
@@ -69,6 +73,13 @@
 #define _32K 32768
 #define _32KD 32768.0
 #define _64K 65536
+#define CHUNK_SIZE 65536	/* input is read in blocks of this size */
+#define ADVISE_WINDOW (8 << 20)	/* mapped input readahead */
+#define DECAY_FLOOR (1.0 / 256)	/* decayed values below this are not drawn */
+#define DECAY_PERIOD 20000	/* usec between decay worker sweeps */
+#define RENDER_TILES 0		/* texture tile pyramid */
+#define RENDER_POINTS 1		/* a point per lit address */
+#define DECAY_RESCALE 1.5	/* worker rescales pages this far behind */
 
 #ifndef MIN
 #define MIN(a,b) (a<b?a:b)
@@ -79,6 +90,15 @@ typedef struct {
     uint16_t a, b, c, d;
 } dq;
 
+/*
+ * A parsed input record.  'value' is -1 when the input gave no explicit
+ * color value and the address should simply be incremented.
+ */
+typedef struct {
+    unsigned int ip;
+    int value;
+} record;
+
 /*
  * Program Globals
  */
@@ -94,19 +114,21 @@ static int WINHEIGHT = 786;
 static bool OPT_FULLSCREEN = 0;
 static bool OPT_AUTO_POINT_SIZE = 0;
 static bool OPT_INPUT_UNTIMED = 0;
+static bool OPT_INPUT_BINARY = 0;
+static bool OPT_INPUT_VALUE = 0;
+static bool OPT_INPUT_PCAP = 0;
+static bool OPT_PCAP_DST = 0;	/* map destination, not source, addresses */
 static const int ZOOM_STEPS = 20;     // number of steps to double
 static int ZOOM_INDEX = 20;
 static unsigned int MASK_KEEP = 0xffffffff;
 static unsigned int MASK_SET = 0;
 static unsigned int OPT_BREAKPOINTS[100];
 static unsigned int BREAKPOINT_IDX = 0;
+static unsigned int OPT_THREADS = 1;
+static int OPT_STORAGE = DATA_TRIE;
+static int OPT_RENDER = RENDER_TILES;
 
 
-/*
- * Global Constants
- */
-static const char *WHITESPACE = " \t\r\n";
-
 /*
  * Non-Config Globals
  */
@@ -119,11 +141,15 @@ static double ZOOM_BASE;
 static GLfloat ZOOM_SCALE = 1.0;
 static double QPS = 0;
 static bool READING = 0;
-static int STREAM = -1;         /* network socket */
+static bool INPUT_MAPPED = 0;	/* -f: input is INPUT_MAP, not stdin */
+static const char *INPUT_MAP = 0;
+static size_t INPUT_SIZE = 0;
 static double FILE_TIME;
 static double FILE_TIME_OFFSET = 0;	/* difference between file time and wall clock */
 static double PLAYBACK_SPEED = 4.0;
 static double DRAW_TIME = 0.0;	/* how long drawData() takes */
+static double DECAY_TIME = 0.0;	/* how long a decay worker sweep takes */
+static bool HALVE = 0;		/* 'h' pressed, for the decay worker */
 static GLfloat POINT_SIZE = 0.0;
 static GLfloat POINT_SCALE = 1.0;
 static void *hud_font = GLUT_BITMAP_9_BY_15;
@@ -145,8 +171,8 @@ static unsigned int FADE_START = 0;
 
 
 static pthread_t threadReadData;
+static pthread_t threadDecay;
 //static pthread_t threadViewUpdate;
-static pthread_mutex_t mutexData;
 
 /*
  * External functions which are not in .h files
@@ -155,19 +181,13 @@ extern unsigned int xy_from_ip(unsigned ip, unsigned *xp, unsigned *yp);
 extern unsigned int ip_from_xy(unsigned x, unsigned y, unsigned *ip);
 extern int set_order();
 extern void set_bits_per_pixel(int);
+extern void set_morton_mode(void);
 
 /*
  * In-file Prototypes
  */
-void decayData(double);
 void decayByHalf();
-
-#if DATA_DOUBLES
-#define DATA_TYPE double
-#else
-#define DATA_TYPE uint8_t
-#endif
-DATA_TYPE ****DATA = 0;
+void half_life_changed();
 
 dq
 dq_from_ip(unsigned int i)
@@ -186,230 +206,911 @@ ip_from_dq(dq dq)
     return (dq.a << 24) | (dq.b << 16) | (dq.c << 8) | dq.d;
 }
 
+/*
+ * Decay is lazy.  Each page records the file time its counters were last
+ * decayed to, and the renderer scales what it reads by the decay since
+ * the page's stamp.  Writers leave the page alone and instead scale what
+ * they add up by the same amount, so that it reads back at full strength.
+ * Pages that are not written or drawn cost nothing, and a new HALF_LIFE
+ * applies to everything at once.
+ */
+double
+decay_factor(double dt)
+{
+    if (HALF_LIFE <= 0.0 || dt <= 0.0)
+	return 1.0;
+    return exp2(-dt / HALF_LIFE);
+}
+
+/*
+ * 2^d for 0 <= d < 1, to within 1e-8: a Taylor series about d = 1/2,
+ * which costs a few multiplies where exp2() costs a library call
+ */
+static double
+exp2_unit(double d)
+{
+    double x = d - 0.5;
+    return 1.4142135623730951 + x * (0.9802581434685472 + x * (0.3397315841830749 +
+	x * (0.07849466324122069 + x * (0.013602088628663626 + x * (0.0018856498765369369 +
+	x * (0.00021783881590746446 + x * 2.157062300896799e-05))))));
+}
+
+/*
+ * The last factor page_catch_up() worked out on this thread.  It holds
+ * for every page with the same stamp until FILE_TIME moves, and pages
+ * rescaled by the same sweep share a stamp.
+ */
+static __thread struct {
+    double now;
+    double stamp;
+    double half_life;
+    double g;
+} CATCH_UP;
+
+/*
+ * Called with the page's lock held before writing to the page holding D.
+ * Returns the factor to scale writes by.  The decay worker normally
+ * rescales pages well before that reaches 2, but if it falls behind the
+ * writer does it here, so that cells stay in range.  This runs for every
+ * record, so a factor below 2 comes from CATCH_UP or exp2_unit() rather
+ * than exp2().
+ */
+double
+page_catch_up(DATA_TYPE *D, data_meta *m)
+{
+    double dt;
+    double d;
+    if (0.0 == m->stamp) {
+	m->stamp = FILE_TIME;
+	return 1.0;
+    }
+    if (FILE_TIME == CATCH_UP.now && m->stamp == CATCH_UP.stamp && HALF_LIFE == CATCH_UP.half_life)
+	return CATCH_UP.g;
+    dt = FILE_TIME - m->stamp;
+    if (HALF_LIFE <= 0.0 || dt <= 0.0)
+	return 1.0;
+    d = dt / HALF_LIFE;
+    if (d >= 1.0) {
+	data_rescale(D, m, decay_factor(dt), FILE_TIME);
+	return 1.0;
+    }
+    CATCH_UP.now = FILE_TIME;
+    CATCH_UP.stamp = m->stamp;
+    CATCH_UP.half_life = HALF_LIFE;
+    CATCH_UP.g = exp2_unit(d);
+    return CATCH_UP.g;
+}
+
+/*
+ * Find and lock the counter for address 'i', looking again if the decay
+ * worker retired its page while we waited for the lock.  Each call is a
+ * quiescent state: the caller holds no page pointers from before it.
+ */
 DATA_TYPE *
-data_ptr(unsigned int i)
+lock_cell(unsigned int i, data_meta **m)
 {
-    DATA_TYPE ****A;
-    DATA_TYPE ***B;
-    DATA_TYPE **C;
     DATA_TYPE *D;
-    dq dq = dq_from_ip(i);
-    pthread_mutex_lock(&mutexData);
-    A = DATA + dq.a;
-    if (0 == *A)
-	*A = calloc(256, sizeof(**A));
-    if (0 == *A)
-	return 0;
-    B = (*A) + dq.b;
-    if (0 == *B)
-	*B = calloc(256, sizeof(**B));
-    if (0 == *B)
-	return 0;
-    C = (*B) + dq.c;
-    if (0 == *C)
-	*C = calloc(256, sizeof(**C));
-    if (0 == *C)
-	return 0;
-    D = (*C) + dq.d;
-    pthread_mutex_unlock(&mutexData);
-    return D;
+    data_quiescent();
+    for (;;) {
+	if (0 == (D = data_ptr(i, m)))
+	    return 0;
+	data_lock(*m);
+	if (!(*m)->dead)
+	    return D;
+	data_unlock(*m);
+    }
 }
 
+/*
+ * Only the thread that owns an address's /8 writes to its page, and the
+ * page lock keeps it apart from the decay worker, so counter updates are
+ * plain loads and stores.  Each write marks its /24 for the renderer.
+ */
 void
 data_inc(unsigned int i)
 {
-    DATA_TYPE *D = data_ptr((i & MASK_KEEP) | MASK_SET);
-    if (0 == D)
+    data_meta *m;
+    double g;
+    double v;
+    DATA_TYPE *D;
+    i = (i & MASK_KEEP) | MASK_SET;
+    if (0 == (D = lock_cell(i, &m)))
 	return;
-    if (*D < NUM_DATA_COLORS - 1)
-	(*D)++;
+    g = page_catch_up(D - (i & 0xFF), m);
+    if (*D < DATA_MAX * g) {
+	v = *D + data_round(DATA_ONE * g);
+	*D = v < DATA_CELL_MAX ? v : DATA_CELL_MAX;
+	data_mark(m, i & 0xFF);
+	m->live = 1;
+	data_dirty(i);
+    }
+    data_unlock(m);
 }
 
 void
 data_set(unsigned int i, unsigned int v)
 {
-    DATA_TYPE *D = data_ptr((i & MASK_KEEP) | MASK_SET);
-    if (0 == D)
+    data_meta *m;
+    double g;
+    double c;
+    DATA_TYPE *D;
+    i = (i & MASK_KEEP) | MASK_SET;
+    if (0 == (D = lock_cell(i, &m)))
 	return;
     if (v > 255)
 	v = 255;
-    *D = v;
+    g = page_catch_up(D - (i & 0xFF), m);
+    c = data_round(v * DATA_ONE * g);
+    *D = c < DATA_CELL_MAX ? c : DATA_CELL_MAX;
+    data_mark(m, i & 0xFF);
+    m->live = 1;
+    data_dirty(i);
+    data_unlock(m);
 }
 
 void
-read_input_stdin(void)
+record_apply(const record *r)
+{
+    if (r->value < 0)
+	data_inc(r->ip);
+    else
+	data_set(r->ip, r->value);
+}
+
+/*
+ * Parse one line of input, p[0..end), into 'r'.  Timed input is "time ip
+ * [value]" and untimed input is "ip [value]".  The time is only stored
+ * in 't' if it parses.  Returns 0 if there is no usable record on the
+ * line.
+ */
+int
+parse_line(const char *p, const char *end, unsigned int line, bool timed, double *t, record *r)
+{
+    const char *e;
+    unsigned long v;
+
+    /*
+     * The first field is a timestamp
+     */
+    if (timed) {
+	p = parse_skip_space(p, end);
+	if (p == end)
+	    return 0;
+	if (NULL == (e = parse_time(p, end, t))) {
+	    e = parse_field_end(p, end);
+	    warnx("bad input parsing time on line %u: %.*s", line, (int)(e - p), p);
+	}
+	p = e;
+    }
+
+    /*
+     * next field is an IP address.  We also accept its integer notation
+     * equivalent.
+     */
+    p = parse_skip_space(p, end);
+    if (p == end)
+	return 0;
+    if (NULL == (e = parse_ip(p, end, &r->ip))) {
+	e = parse_field_end(p, end);
+	warnx("bad input parsing IP on line %u: %.*s", line, (int)(e - p), p);
+	return 0;
+    }
+
+    /* check for color value */
+    p = parse_skip_space(e, end);
+    if (p == end) {
+	r->value = -1;
+    } else {
+	v = parse_ulong(p, end);
+	r->value = v > 255 ? 255 : v;
+    }
+    return 1;
+}
+
+/*
+ * Map the -f input file so the readers can parse it in place
+ */
+void
+map_input(const char *path)
+{
+    struct stat st;
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+	err(1, "%s", path);
+    if (fstat(fd, &st) < 0)
+	err(1, "%s", path);
+    INPUT_SIZE = st.st_size;
+    if (INPUT_SIZE) {
+	INPUT_MAP = mmap(0, INPUT_SIZE, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (MAP_FAILED == INPUT_MAP)
+	    err(1, "mmap %s", path);
+	madvise((void *)INPUT_MAP, INPUT_SIZE, MADV_SEQUENTIAL);
+	madvise((void *)INPUT_MAP, MIN(INPUT_SIZE, ADVISE_WINDOW), MADV_WILLNEED);
+    }
+    INPUT_MAPPED = 1;
+    close(fd);
+}
+
+/*
+ * Called as the reader moves through the mapped input.  When it enters a
+ * new window, ask for the next one to be read ahead and let the kernel
+ * drop the one two windows back, so a long replay does not fill the page
+ * cache with input we are done with.
+ */
+void
+advise_input(size_t off)
+{
+    static size_t next = 0;
+    size_t w;
+    if (off < next)
+	return;
+    w = off - off % ADVISE_WINDOW;
+    if (w + ADVISE_WINDOW < INPUT_SIZE)
+	madvise((void *)(INPUT_MAP + w + ADVISE_WINDOW), MIN(ADVISE_WINDOW, INPUT_SIZE - w - ADVISE_WINDOW), MADV_WILLNEED);
+    if (w >= 2 * ADVISE_WINDOW)
+	madvise((void *)(INPUT_MAP + w - 2 * ADVISE_WINDOW), ADVISE_WINDOW, MADV_DONTNEED);
+    next = w + ADVISE_WINDOW;
+}
+
+/*
+ * Buffered line reader over stdin or the mapped input file.  Lines are
+ * returned in place, without their newline, and stay valid until the next
+ * call.  Lines longer than the buffer are split.
+ */
+typedef struct {
+    const char *data;		/* buf, or INPUT_MAP */
+    size_t size;
+    size_t off;
+    size_t len;
+    bool eof;
+    char buf[CHUNK_SIZE];
+} linereader;
+
+void
+linereader_init(linereader *lr)
+{
+    memset(lr, 0, offsetof(linereader, buf));
+    if (INPUT_MAPPED) {
+	lr->data = INPUT_MAP;
+	lr->size = lr->len = INPUT_SIZE;
+	lr->eof = 1;
+    } else {
+	lr->data = lr->buf;
+	lr->size = CHUNK_SIZE;
+    }
+}
+
+int
+next_line(linereader *lr, const char **lp, const char **ep)
+{
+    for (;;) {
+	const char *p = lr->data + lr->off;
+	const char *end = lr->data + lr->len;
+	const char *e = parse_eol(p, end);
+	ssize_t x;
+	if (e < end || (p < end && (lr->eof || end - p == lr->size))) {
+	    *lp = p;
+	    *ep = e;
+	    lr->off = e - lr->data + (e < end);
+	    if (INPUT_MAPPED)
+		advise_input(lr->off);
+	    return 1;
+	}
+	if (lr->eof)
+	    return 0;
+	memmove(lr->buf, p, end - p);
+	lr->len = end - p;
+	lr->off = 0;
+	data_offline();
+	x = read(0, lr->buf + lr->len, lr->size - lr->len);
+	if (x < 0 && EINTR == errno)
+	    continue;
+	if (x <= 0)
+	    lr->eof = 1;
+	else
+	    lr->len += x;
+    }
+}
+
+/*
+ * Recompute QPS from the records counted since the last call, at most
+ * once per millisecond of file time
+ */
+void
+update_qps(void)
 {
-    static double NEXT_PAUSE_CHECK = 0.0;
     static double LAST_QPS_TIME = 0.0;
     static unsigned int PNQUERY;
-    char buf[512];
-    unsigned int line = 1;
+    if (FILE_TIME - LAST_QPS_TIME < 0.001)
+	return;
+    QPS = (double) (NQUERY - PNQUERY) / (FILE_TIME - LAST_QPS_TIME);
+    LAST_QPS_TIME = FILE_TIME;
+    PNQUERY = NQUERY;
+}
+
+/*
+ * Block while playback is paused.  Readers go offline for page
+ * reclamation whenever they might block, so that a stalled input does
+ * not keep retired pages from being freed.
+ */
+void
+wait_reading(void)
+{
+    if (READING)
+	return;
+    data_offline();
+    while (!READING)
+	usleep(1000);
+}
+
+/*
+ * How long to hold back a reader that has reached file time 't' so that
+ * playback runs at PLAYBACK_SPEED times the wall clock, at most a second.
+ * The first call sets the origin.  Safe to call from several threads.
+ */
+double
+pace_delay(double t)
+{
+    double zero = 0.0;
+    double now;
+    double offset;
+    double delta;
+    struct timeval tv;
+    gettimeofday(&tv, 0);
+    now = tv.tv_sec + 0.000001 * tv.tv_usec;
+    offset = now - (t / PLAYBACK_SPEED);
+    if (__atomic_compare_exchange(&FILE_TIME_OFFSET, &zero, &offset, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+	return 0.0;
+    /* zero now holds the origin already set */
+    delta = (t / PLAYBACK_SPEED) + zero - now;
+    return delta > 1.0 ? 1.0 : delta;
+}
+
+/*
+ * Hold the reader back so that FILE_TIME advances at PLAYBACK_SPEED times
+ * the wall clock, and keep the QPS estimate up to date.  Called by the
+ * readers each time FILE_TIME moves.
+ */
+void
+pace_playback(void)
+{
+    static double NEXT_PAUSE_CHECK = 0.0;
+    double delta;
+    if (FILE_TIME < NEXT_PAUSE_CHECK)
+	return;
+    update_qps();
+    NEXT_PAUSE_CHECK = FILE_TIME + 0.001;
+    delta = pace_delay(FILE_TIME);
+    if (delta > 0) {
+	unsigned int sleep_usecs = 1000000 * delta;
+	data_offline();
+	usleep(sleep_usecs);
+    }
+}
+
+void
+read_input_stdin(void)
+{
+    static linereader lr;
+    unsigned int line = 0;
+    linereader_init(&lr);
     for (;;) {
-	unsigned int i;
-	char *strtok_arg = buf;
-	char *t;
-	char *e;
-	while (!READING)
-	    usleep(1000);
+	const char *p;
+	const char *e;
+	record r;
+	double t = FILE_TIME;
+	wait_reading();
 
-	if (0 == fgets(buf, 512, stdin)) {
+	if (0 == next_line(&lr, &p, &e)) {
 	    READING = 0;
 	    return;
 	}
+	line++;
 	NQUERY++;
 	if (OPT_BREAKPOINTS[BREAKPOINT_IDX] == NQUERY) {
 	    READING = 0;
 	    BREAKPOINT_IDX++;
 	    continue;
 	}
-	/*
-	 * The first field is a timestamp
-	 */
-	t = strtok(strtok_arg, WHITESPACE);
-	strtok_arg = NULL;
-	if (NULL == t)
-	    continue;
-	FILE_TIME = strtod(t, &e);
-	if (e == t)
-	    warnx("bad input parsing time on line %d: %s", line, t);
-
-	/*
-	 * next field is an IP address.  We also accept its integer notation
-	 * equivalent.
-	 */
-	t = strtok(strtok_arg, WHITESPACE);
-	if (NULL == t)
+	if (0 == parse_line(p, e, line, 1, &t, &r))
 	    continue;
-	if (strspn(t, "0123456789") == strlen(t))
-	    i = strtoul(t, NULL, 10);
-	else if (1 == inet_pton(AF_INET, t, &i))
-	    i = ntohl(i);
-	else
-	    warnx("bad input parsing IP on line %d: %s", line, t);
+	FILE_TIME = t;
+	record_apply(&r);
+	pace_playback();
+    }
+}
 
-	//if (debug)
-	    //fprintf(stderr, "%s => %u =>\n", t, i);
+/*
+ * Sharded ingest (-j threads).
+ *
+ * The reader thread cuts stdin into chunks of whole lines and queues them
+ * for a pool of parser threads.  Each parser thread also owns the /8s
+ * whose first octet is congruent to its index modulo the pool size:
+ * records for its own /8s are applied directly and the rest are batched
+ * and handed to the owning thread, so no two threads ever write the same
+ * part of DATA.  The reader keeps NQUERY and the QPS estimate, which
+ * advance a chunk at a time.  Each parser thread moves FILE_TIME up to
+ * the timestamps it parses, a millisecond at a time, and holds itself
+ * back to the playback speed, so FILE_TIME is the latest time any of
+ * them has reached.
+ */
+#define BATCH_SIZE 4096
+#define MAX_SHARDS 64
+
+typedef struct chunk {
+    struct chunk *next;
+    unsigned int line;		/* number of the first line */
+    const char *p;		/* buf, or a slice of INPUT_MAP */
+    size_t len;
+    char buf[];
+} chunk;
+
+typedef struct batch {
+    struct batch *next;
+    unsigned int n;
+    record r[BATCH_SIZE];
+} batch;
 
-	/* check for color value */
-	t = strtok(strtok_arg, WHITESPACE);
-	if (NULL == t)
-		data_inc(i);
-	else
-		data_set(i, strtoul(t, NULL, 10));
+typedef struct {
+    pthread_t thread;
+    unsigned int id;
+    batch *inbox;		/* records owned by this shard */
+    batch **inbox_tail;
+    batch *out[MAX_SHARDS];	/* records being collected for others */
+    double next_time;		/* when to next move FILE_TIME */
+} shard;
+
+static shard SHARDS[MAX_SHARDS];
+static chunk *CHUNKS = 0;
+static chunk **CHUNKS_TAIL = &CHUNKS;
+static unsigned int NCHUNKS = 0;
+static unsigned int NPARSING = 0;
+static bool CHUNKS_DONE = 0;
+static pthread_mutex_t mutexShard = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t condShard = PTHREAD_COND_INITIALIZER;
+
+void
+shard_send(shard *s, unsigned int owner)
+{
+    batch *b = s->out[owner];
+    if (0 == b)
+	return;
+    s->out[owner] = 0;
+    b->next = 0;
+    pthread_mutex_lock(&mutexShard);
+    *SHARDS[owner].inbox_tail = b;
+    SHARDS[owner].inbox_tail = &b->next;
+    pthread_cond_broadcast(&condShard);
+    pthread_mutex_unlock(&mutexShard);
+}
+
+void
+shard_emit(shard *s, const record *r)
+{
+    unsigned int owner = (((r->ip & MASK_KEEP) | MASK_SET) >> 24) % OPT_THREADS;
+    batch *b;
+    if (owner == s->id) {
+	record_apply(r);
+	return;
+    }
+    if (0 == (b = s->out[owner])) {
+	if (0 == (b = malloc(sizeof(*b))))
+	    return;
+	b->n = 0;
+	s->out[owner] = b;
+    }
+    b->r[b->n++] = *r;
+    if (BATCH_SIZE == b->n)
+	shard_send(s, owner);
+}
+
+/*
+ * A parser thread has reached file time 't'.  If playback is behind
+ * that, hand over the records batched so far and sleep until it catches
+ * up, then move FILE_TIME up to 't' unless another thread is already
+ * further on.  Sleeping first keeps a thread that has taken a later chunk
+ * from dragging FILE_TIME ahead of the others.
+ */
+void
+shard_time(shard *s, double t)
+{
+    double now;
+    double delta;
+    unsigned int i;
+    if ((delta = pace_delay(t)) > 0) {
+	for (i = 0; i < OPT_THREADS; i++)
+	    shard_send(s, i);
+	data_offline();
+	usleep(1000000 * delta);
+    }
+    __atomic_load(&FILE_TIME, &now, __ATOMIC_RELAXED);
+    while (t > now && !__atomic_compare_exchange(&FILE_TIME, &now, &t, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+	;
+    s->next_time = t + 0.001;
+}
+
+void
+shard_parse(shard *s, chunk *c)
+{
+    const char *p = c->p;
+    const char *end = c->p + c->len;
+    unsigned int line = c->line;
+    unsigned int i;
+    double t;
+    record r;
+    while (p < end) {
+	const char *eol = parse_eol(p, end);
+	if (parse_line(p, eol, line, 1, &t, &r)) {
+	    if (t >= s->next_time)
+		shard_time(s, t);
+	    shard_emit(s, &r);
+	}
+	p = eol + 1;
 	line++;
-	if (FILE_TIME >= NEXT_PAUSE_CHECK) {
-	    double now;
-	    double delta;
-	    struct timeval tv;
-	    gettimeofday(&tv, 0);
-	    now = tv.tv_sec + 0.000001 * tv.tv_usec;
-	    if (0 == FILE_TIME_OFFSET) {
-		FILE_TIME_OFFSET = now - (FILE_TIME / PLAYBACK_SPEED);
-		delta = 0;
-	    } else {
-	        delta = (FILE_TIME / PLAYBACK_SPEED) + FILE_TIME_OFFSET - now;
-	    }
-	    QPS = (double) (NQUERY - PNQUERY) / (FILE_TIME - LAST_QPS_TIME);
-	    LAST_QPS_TIME = FILE_TIME;
-	    NEXT_PAUSE_CHECK = FILE_TIME + 0.001;
-	    PNQUERY = NQUERY;
-	    if (delta > 0) {
-		if (delta > 1.0)
-			delta = 1.0;
-		unsigned int sleep_usecs = 1000000 * delta;
-		usleep(sleep_usecs);
+    }
+    for (i = 0; i < OPT_THREADS; i++)
+	shard_send(s, i);
+}
+
+void *
+shard_main(void *arg)
+{
+    shard *s = arg;
+    batch *b;
+    chunk *c;
+    unsigned int i;
+    pthread_mutex_lock(&mutexShard);
+    for (;;) {
+	if ((b = s->inbox)) {
+	    s->inbox = 0;
+	    s->inbox_tail = &s->inbox;
+	    pthread_mutex_unlock(&mutexShard);
+	    while (b) {
+		batch *next = b->next;
+		for (i = 0; i < b->n; i++)
+		    record_apply(&b->r[i]);
+		free(b);
+		b = next;
 	    }
+	    pthread_mutex_lock(&mutexShard);
+	} else if ((c = CHUNKS)) {
+	    if (0 == (CHUNKS = c->next))
+		CHUNKS_TAIL = &CHUNKS;
+	    NCHUNKS--;
+	    NPARSING++;
+	    pthread_cond_broadcast(&condShard);
+	    pthread_mutex_unlock(&mutexShard);
+	    shard_parse(s, c);
+	    free(c);
+	    pthread_mutex_lock(&mutexShard);
+	    NPARSING--;
+	    pthread_cond_broadcast(&condShard);
+	} else if (CHUNKS_DONE && 0 == NPARSING) {
+	    break;
+	} else {
+	    data_offline();
+	    pthread_cond_wait(&condShard, &mutexShard);
 	}
     }
+    pthread_mutex_unlock(&mutexShard);
+    data_offline();
+    return 0;
+}
+
+/*
+ * Count up to 'max' lines in buf[0..len) and set '*used' to the offset
+ * just past the last one counted.  An unterminated line at the end
+ * counts too.
+ */
+unsigned int
+count_lines(const char *buf, size_t len, unsigned int max, size_t *used)
+{
+    const char *p = buf;
+    const char *e;
+    unsigned int n = 0;
+    while (n < max && (e = memchr(p, '\n', buf + len - p))) {
+	p = e + 1;
+	n++;
+    }
+    if (n < max && p < buf + len) {
+	p = buf + len;
+	n++;
+    }
+    *used = p - buf;
+    return n;
 }
 
 void
-read_input_stdin_binary(void)
+shard_queue(chunk *c, unsigned int nlines)
 {
-    unsigned int i1;
-    unsigned int i2;
+    c->line = NQUERY - nlines + 1;
+    update_qps();
+    c->next = 0;
+    pthread_mutex_lock(&mutexShard);
+    if (NCHUNKS >= 4 * OPT_THREADS)
+	data_offline();
+    while (NCHUNKS >= 4 * OPT_THREADS)
+	pthread_cond_wait(&condShard, &mutexShard);
+    *CHUNKS_TAIL = c;
+    CHUNKS_TAIL = &c->next;
+    NCHUNKS++;
+    pthread_cond_broadcast(&condShard);
+    pthread_mutex_unlock(&mutexShard);
+}
+
+void
+read_input_sharded(void)
+{
+    chunk *c = 0;
+    size_t off = 0;
+    size_t have = 0;
+    bool eof = 0;
+    unsigned int i;
+    for (i = 0; i < OPT_THREADS; i++) {
+	SHARDS[i].id = i;
+	SHARDS[i].inbox_tail = &SHARDS[i].inbox;
+	pthread_create(&SHARDS[i].thread, 0, shard_main, &SHARDS[i]);
+    }
     for (;;) {
-	while (!READING)
-	    usleep(1000);
-	if (4 != read(0, &i1, 4)) {
-	    READING = 0;
-	    return;
+	chunk *next = 0;
+	const char *p;
+	ssize_t x;
+	size_t len;
+	size_t skip = 0;
+	unsigned int n;
+	unsigned int bp;
+	wait_reading();
+	if (INPUT_MAPPED) {
+	    /*
+	     * Chunks of a mapped file are just slices of the mapping
+	     */
+	    if (0 == (c = malloc(sizeof(*c))))
+		err(1, "malloc");
+	    p = INPUT_MAP + off;
+	    have = MIN(CHUNK_SIZE, INPUT_SIZE - off);
+	    eof = (off + have == INPUT_SIZE);
+	    advise_input(off);
+	} else {
+	    if (0 == c && 0 == (c = malloc(sizeof(*c) + CHUNK_SIZE)))
+		err(1, "malloc");
+	    p = c->buf;
+	    if (!eof) {
+		data_offline();
+		x = read(0, c->buf + have, CHUNK_SIZE - have);
+		if (x < 0 && EINTR == errno)
+		    continue;
+		if (x <= 0)
+		    eof = 1;
+		else
+		    have += x;
+	    }
+	}
+	if (eof && 0 == have)
+	    break;
+	for (len = have; len && '\n' != p[len - 1]; len--);
+	if (0 == len) {
+	    if (have < CHUNK_SIZE && !eof)
+		continue;
+	    /* unterminated last line, or overlong line: just break it */
+	    len = have;
 	}
-	if (4 != read(0, &i2, 4)) {
+	n = count_lines(p, len, ~0, &len);
+	bp = OPT_BREAKPOINTS[BREAKPOINT_IDX];
+	if (bp > NQUERY && bp - NQUERY <= n) {
+	    /*
+	     * Stop before the breakpoint line and skip it, as
+	     * read_input_stdin() does
+	     */
+	    n = count_lines(p, len, bp - NQUERY - 1, &len);
+	    count_lines(p + len, have - len, 1, &skip);
 	    READING = 0;
-	    return;
+	    BREAKPOINT_IDX++;
+	}
+	if (INPUT_MAPPED) {
+	    off += len + skip;
+	} else {
+	    if (0 == (next = malloc(sizeof(*next) + CHUNK_SIZE)))
+		err(1, "malloc");
+	    memcpy(next->buf, p + len + skip, have - len - skip);
+	    have -= len + skip;
+	}
+	if (n) {
+	    NQUERY += n;
+	    c->p = p;
+	    c->len = len;
+	    shard_queue(c, n);
+	} else {
+	    free(c);
 	}
+	if (skip)
+	    NQUERY++;
+	c = next;
+    }
+    free(c);
+    pthread_mutex_lock(&mutexShard);
+    CHUNKS_DONE = 1;
+    pthread_cond_broadcast(&condShard);
+    pthread_mutex_unlock(&mutexShard);
+    for (i = 0; i < OPT_THREADS; i++)
+	pthread_join(SHARDS[i].thread, 0);
+    READING = 0;
+}
+
+/*
+ * Binary input (-B).  Each record is a 32-bit timestamp in network byte
+ * order followed by the 32-bit address in host byte order, plus a 32-bit
+ * color value in network byte order with -V.  Input is read (or mapped)
+ * in large blocks and decoded a block at a time.
+ */
+#define BINARY_BUFSIZE (1 << 20)
+
+void
+read_input_binary(void)
+{
+    static char buf[BINARY_BUFSIZE];
+    const size_t rsize = OPT_INPUT_VALUE ? 12 : 8;
+    const char *p = buf;
+    const char *end = buf;
+    if (INPUT_MAPPED) {
+	p = INPUT_MAP;
+	end = INPUT_MAP + INPUT_SIZE;
+    }
+    for (;;) {
+	const char *lim;
+	wait_reading();
+	if (end - p < rsize) {
+	    ssize_t x;
+	    if (INPUT_MAPPED)
+		break;
+	    memmove(buf, p, end - p);
+	    end = buf + (end - p);
+	    p = buf;
+	    data_offline();
+	    x = read(0, (char *)end, BINARY_BUFSIZE - (end - buf));
+	    if (x < 0 && EINTR == errno)
+		continue;
+	    if (x <= 0)
+		break;
+	    end += x;
+	    continue;
+	}
+	if (INPUT_MAPPED)
+	    advise_input(p - INPUT_MAP);
+	lim = end - p > BINARY_BUFSIZE ? p + BINARY_BUFSIZE : end;
+	for (; lim - p >= rsize && READING; p += rsize) {
+	    uint32_t t;
+	    uint32_t i;
+	    uint32_t v;
+	    NQUERY++;
+	    if (OPT_BREAKPOINTS[BREAKPOINT_IDX] == NQUERY) {
+		READING = 0;
+		BREAKPOINT_IDX++;
+		continue;
+	    }
+	    memcpy(&t, p, 4);
+	    memcpy(&i, p + 4, 4);
+	    FILE_TIME = (double)ntohl(t);
+	    if (OPT_INPUT_VALUE) {
+		memcpy(&v, p + 8, 4);
+		data_set(i, ntohl(v));
+	    } else {
+		data_inc(i);
+	    }
+	    pace_playback();
+	}
+    }
+    READING = 0;
+}
+
+/*
+ * Packet capture input (-P).  Classic pcap or pcapng, read (or mapped) in
+ * large blocks like -B, with the addresses taken straight from the packets
+ * by pcap_next().
+ */
+void
+read_input_pcap(void)
+{
+    static char buf[BINARY_BUFSIZE];
+    pcap_state ps;
+    const char *p = buf;
+    const char *end = buf;
+    bool opened = 0;
+    if (INPUT_MAPPED) {
+	p = INPUT_MAP;
+	end = INPUT_MAP + INPUT_SIZE;
+    }
+    for (;;) {
+	const char *next = p;
+	double t = FILE_TIME;
+	unsigned int src;
+	unsigned int dst;
+	int x;
+	wait_reading();
+	if (!opened)
+	    x = pcap_open(&ps, p, end, &next);
+	else
+	    x = pcap_next(&ps, p, end, &next, &t, &src, &dst);
+	if (PCAP_BAD == x)
+	    errx(1, "input is not a pcap or pcapng capture, or is corrupt");
+	if (PCAP_MORE == x) {
+	    ssize_t n;
+	    if (INPUT_MAPPED)
+		break;
+	    if (p == buf && end == buf + BINARY_BUFSIZE)
+		errx(1, "capture record larger than %d bytes", BINARY_BUFSIZE);
+	    memmove(buf, p, end - p);
+	    end = buf + (end - p);
+	    p = buf;
+	    data_offline();
+	    n = read(0, (char *)end, BINARY_BUFSIZE - (end - buf));
+	    if (n < 0 && EINTR == errno)
+		continue;
+	    if (n <= 0)
+		break;
+	    end += n;
+	    continue;
+	}
+	p = next;
+	if (INPUT_MAPPED)
+	    advise_input(p - INPUT_MAP);
+	if (!opened) {
+	    opened = 1;
+	    continue;
+	}
+	if (PCAP_SKIP == x)
+	    continue;
 	NQUERY++;
-	/*
-	 * The first field is a timestamp
-	 */
-	FILE_TIME = (double)ntohl(i1);
-	/*
-	 * next field is an IP address.  We also accept its integer notation
-	 * equivalent.
-	 */
-	data_inc(i2);
-	if (0 == (NQUERY & 0xfff))
-	    usleep(10000);
+	if (OPT_BREAKPOINTS[BREAKPOINT_IDX] == NQUERY) {
+	    READING = 0;
+	    BREAKPOINT_IDX++;
+	    continue;
+	}
+	FILE_TIME = t;
+	data_inc(OPT_PCAP_DST ? dst : src);
+	pace_playback();
     }
+    READING = 0;
 }
 
 void
 read_input_untimed(void)
 {
-    char buf[512];
+    static linereader lr;
     unsigned int line = 1;
+    linereader_init(&lr);
     while (line < 8192) {
-	unsigned int i;
-	char *strtok_arg = buf;
-	char *t;
+	const char *p;
+	const char *e;
+	record r;
+	double t;
 
-	if (0 == fgets(buf, 512, stdin)) {
+	if (0 == next_line(&lr, &p, &e)) {
 	    READING = 0;
 	    return;
 	}
 	NQUERY++;
-
-	/*
-	 * first field is an IP address.  We also accept its integer notation
-	 * equivalent.
-	 */
-	t = strtok(strtok_arg, WHITESPACE);
-	strtok_arg = NULL;
-	if (NULL == t)
-	    continue;
-	if (strspn(t, "0123456789") == strlen(t))
-	    i = strtoul(t, NULL, 10);
-	else if (1 == inet_pton(AF_INET, t, &i))
-	    i = ntohl(i);
-	else
-	    warnx("bad input parsing IP on line %d: %s", line, t);
-
-	/*
-	 * next (optional) field is a value
-	 */
-	t = strtok(strtok_arg, WHITESPACE);
-	if (NULL == t) {
-	    data_inc(i);
-	} else {
-	    unsigned int v;
-	    v = strtoul(t, NULL, 10);
-	    data_set(i, v);
-	}
+	if (parse_line(p, e, line, 0, &t, &r))
+	    record_apply(&r);
 	line++;
     }
 }
 
+/*
+ * Read exactly 'len' bytes unless the peer closes first.  Returns the
+ * number of bytes read, or -1 on error.
+ */
 int
 blocking_read(int s, void *buf, int len)
 {
     int n = 0;
     while (len) {
 	int x = read(s, buf, len);
+	if (x < 0 && EINTR == errno)
+	    continue;
 	if (x < 0)
 	    return x;
 	if (x == 0)
-	    usleep(1000);
+	    break;
 	n += x;
 	len -= x;
 	buf += x;
@@ -417,46 +1118,274 @@ blocking_read(int s, void *buf, int len)
     return n;
 }
 
+/*
+ * Stream input (-s, repeatable).  Each record is 12 bytes: seconds and
+ * microseconds in network byte order, then the address in host byte
+ * order.  The sockets are non-blocking and all of them are served by one
+ * poll() loop; for each readable source we read as much as the kernel has
+ * into that source's buffer and decode every whole record in it at once.
+ * A partial record at the end is moved to the front to be completed by
+ * the next read.
+ *
+ * Datagram input (-U).  Each datagram is a 32-bit sequence number in
+ * network byte order followed by any number of the same 12-byte records.
+ * Sequence numbers are kept per sender; gaps are counted as lost, along
+ * with the kernel's own receive queue drops where it reports them.
+ * Datagrams are received UDP_BATCH at a time with recvmmsg() where the
+ * system declares it (along with MSG_WAITFORONE), else one at a time.
+ *
+ * FILE_TIME is the newest timestamp seen from any source and never moves
+ * backwards, so a source that lags or restarts does not rewind decay.
+ */
+#define STREAM_BUFSIZE (1 << 20)
+#define STREAM_RECSIZE 12
+#define MAX_SOURCES 16
+#define UDP_BATCH 32
+#define UDP_MAXDGRAM 65536
+#define UDP_RCVBUF (16 << 20)
+#define MAX_PEERS 64
+
+#if defined(MSG_WAITFORONE)
+#define HAVE_RECVMMSG 1
+typedef struct mmsghdr udp_msg;
+#else
+typedef struct {
+    struct msghdr msg_hdr;
+    unsigned int msg_len;
+} udp_msg;
+#endif
+
+typedef struct {
+    struct sockaddr_in addr;
+    uint32_t next_seq;
+} peer;
+
+typedef struct {
+    char *name;			/* ip:port */
+    int fd;			/* -1 once closed */
+    bool udp;
+    unsigned int nquery;
+    unsigned int lost;		/* datagrams missing from the sequence */
+    unsigned int kdrops;	/* datagrams dropped by the kernel */
+    double file_time;
+    double qps;
+    double qps_time;		/* file time of the last qps update */
+    unsigned int qps_nquery;
+    unsigned int npeers;
+    peer peers[MAX_PEERS];
+    size_t len;
+    char *buf;
+} source;
+
+static source SOURCES[MAX_SOURCES];
+static unsigned int NSOURCES = 0;
+
+/*
+ * Apply 'n' whole records starting at 'p' and update the source and global
+ * counters
+ */
+void
+source_decode(source *src, const char *p, unsigned int n)
+{
+    const char *end = p + n * STREAM_RECSIZE;
+    uint32_t i1;
+    uint32_t i2;
+    uint32_t i3;
+    if (0 == n)
+	return;
+    for (; p < end; p += STREAM_RECSIZE) {
+	memcpy(&i3, p + 8, 4);
+	data_inc(i3);
+    }
+    memcpy(&i1, end - STREAM_RECSIZE, 4);
+    memcpy(&i2, end - STREAM_RECSIZE + 4, 4);
+    src->nquery += n;
+    src->file_time = (double)ntohl(i1) + .000001 * ntohl(i2);
+    if (src->file_time - src->qps_time >= 1.0) {
+	if (src->qps_time)
+	    src->qps = (src->nquery - src->qps_nquery) / (src->file_time - src->qps_time);
+	src->qps_time = src->file_time;
+	src->qps_nquery = src->nquery;
+    }
+    NQUERY += n;
+    if (src->file_time > FILE_TIME)
+	FILE_TIME = src->file_time;
+    update_qps();
+}
+
+/*
+ * Account for datagram 'seq' from 'from'
+ */
 void
-read_input_stream(void)
+source_sequence(source *src, const struct sockaddr_in *from, uint32_t seq)
 {
-    unsigned int i1;
-    unsigned int i2;
-    unsigned int i3;
-    for (;;) {
-	while (!READING)
-	    usleep(1000);
-	if (4 != blocking_read(STREAM, &i1, 4)) {
-	    READING = 0;
+    peer *pr;
+    uint32_t gap;
+    for (pr = src->peers; pr < src->peers + src->npeers; pr++)
+	if (pr->addr.sin_addr.s_addr == from->sin_addr.s_addr && pr->addr.sin_port == from->sin_port)
+	    break;
+    if (pr == src->peers + src->npeers) {
+	if (MAX_PEERS == src->npeers)
 	    return;
+	src->npeers++;
+	pr->addr = *from;
+	pr->next_seq = seq + 1;
+	return;
+    }
+    gap = seq - pr->next_seq;
+    if (gap >= 0x80000000)
+	return;			/* late or duplicate */
+    src->lost += gap;
+    pr->next_seq = seq + 1;
+}
+
+/*
+ * Receive and decode a batch of datagrams.  The buffer is UDP_BATCH
+ * slots of UDP_MAXDGRAM bytes.
+ */
+int
+source_recv(source *src)
+{
+    udp_msg msgs[UDP_BATCH];
+    struct iovec iov[UDP_BATCH];
+    struct sockaddr_in from[UDP_BATCH];
+    union {
+	struct cmsghdr hdr;
+	char buf[CMSG_SPACE(sizeof(uint32_t))];
+    } ctl[UDP_BATCH];
+    struct cmsghdr *cm;
+    int n;
+    int i;
+    memset(msgs, 0, sizeof(msgs));
+    for (i = 0; i < UDP_BATCH; i++) {
+	iov[i].iov_base = src->buf + i * UDP_MAXDGRAM;
+	iov[i].iov_len = UDP_MAXDGRAM;
+	msgs[i].msg_hdr.msg_name = &from[i];
+	msgs[i].msg_hdr.msg_namelen = sizeof(from[i]);
+	msgs[i].msg_hdr.msg_iov = &iov[i];
+	msgs[i].msg_hdr.msg_iovlen = 1;
+	msgs[i].msg_hdr.msg_control = ctl[i].buf;
+	msgs[i].msg_hdr.msg_controllen = sizeof(ctl[i].buf);
+    }
+#if defined(HAVE_RECVMMSG)
+    n = recvmmsg(src->fd, msgs, UDP_BATCH, MSG_DONTWAIT, 0);
+#else
+    for (n = 0; n < UDP_BATCH; n++) {
+	ssize_t x = recvmsg(src->fd, &msgs[n].msg_hdr, MSG_DONTWAIT);
+	if (x < 0)
+	    break;
+	msgs[n].msg_len = x;
+    }
+    if (0 == n)
+	n = -1;
+#endif
+    if (n < 0 && (EAGAIN == errno || EWOULDBLOCK == errno || EINTR == errno))
+	return 1;
+    if (n < 0) {
+	warn("%s", src->name);
+	return 0;
+    }
+    for (i = 0; i < n; i++) {
+	const char *p = iov[i].iov_base;
+	uint32_t seq;
+	for (cm = CMSG_FIRSTHDR(&msgs[i].msg_hdr); cm; cm = CMSG_NXTHDR(&msgs[i].msg_hdr, cm)) {
+#if defined(SO_RXQ_OVFL)
+	    if (SOL_SOCKET == cm->cmsg_level && SO_RXQ_OVFL == cm->cmsg_type)
+		memcpy(&src->kdrops, CMSG_DATA(cm), sizeof(uint32_t));
+#endif
 	}
-	if (4 != blocking_read(STREAM, &i2, 4)) {
-	    READING = 0;
-	    return;
+	if (msgs[i].msg_len < 4)
+	    continue;
+	memcpy(&seq, p, 4);
+	source_sequence(src, &from[i], ntohl(seq));
+	source_decode(src, p + 4, (msgs[i].msg_len - 4) / STREAM_RECSIZE);
+    }
+    return 1;
+}
+
+/*
+ * Read and decode whatever 'src' has for us.  Returns 0 once the source
+ * has closed.
+ */
+int
+source_read(source *src)
+{
+    const char *p;
+    unsigned int n;
+    ssize_t x;
+    if (src->udp)
+	return source_recv(src);
+    x = read(src->fd, src->buf + src->len, STREAM_BUFSIZE - src->len);
+    if (x < 0 && (EAGAIN == errno || EWOULDBLOCK == errno || EINTR == errno))
+	return 1;
+    if (x < 0)
+	warn("%s", src->name);
+    if (x <= 0)
+	return 0;
+    src->len += x;
+    n = src->len / STREAM_RECSIZE;
+    source_decode(src, src->buf, n);
+    p = src->buf + n * STREAM_RECSIZE;
+    src->len = src->buf + src->len - p;
+    memmove(src->buf, p, src->len);
+    return 1;
+}
+
+void
+read_input_stream(void)
+{
+    struct pollfd pfd[MAX_SOURCES];
+    unsigned int nopen = NSOURCES;
+    unsigned int i;
+    for (i = 0; i < NSOURCES; i++) {
+	if (0 == (SOURCES[i].buf = malloc(SOURCES[i].udp ? UDP_BATCH * UDP_MAXDGRAM : STREAM_BUFSIZE)))
+	    err(1, "malloc");
+	pfd[i].fd = SOURCES[i].fd;
+	pfd[i].events = POLLIN;
+    }
+    while (nopen) {
+	wait_reading();
+	data_offline();
+	if (poll(pfd, NSOURCES, -1) < 0) {
+	    if (EINTR == errno)
+		continue;
+	    warn("poll");
+	    break;
 	}
-	if (4 != blocking_read(STREAM, &i3, 4)) {
-	    READING = 0;
-	    return;
+	for (i = 0; i < NSOURCES; i++) {
+	    source *src = &SOURCES[i];
+	    if (0 == pfd[i].revents)
+		continue;
+	    if (source_read(src))
+		continue;
+	    fprintf(stderr, "%s closed\n", src->name);
+	    close(src->fd);
+	    src->fd = -1;
+	    pfd[i].fd = -1;
+	    free(src->buf);
+	    src->buf = 0;
+	    nopen--;
 	}
-	NQUERY++;
-	/*
-	 * The first field is a timestamp
-	 */
-	FILE_TIME = (double)ntohl(i1);
-	FILE_TIME += .000001 * ntohl(i2);
-	data_inc(i3);
     }
+    READING = 0;
 }
 
 void *
 read_input(void *unused)
 {
-    if (STREAM > -1)
+    if (NSOURCES)
 	read_input_stream();
+    else if (OPT_INPUT_BINARY)
+	read_input_binary();
+    else if (OPT_INPUT_PCAP)
+	read_input_pcap();
     else if (OPT_INPUT_UNTIMED)
 	read_input_untimed();
+    else if (OPT_THREADS > 1)
+	read_input_sharded();
     else
 	read_input_stdin();
+    data_offline();
     fprintf(stderr, "exiting read_input()\n");
     return 0;
 }
@@ -502,10 +1431,9 @@ void
 drawData()
 {
     dq dq = {0, 0, 0, 0};
-    double R, G, B;
-    double R0 = -1.0;
-    double G0 = -1.0;
-    double B0 = -1.0;
+    uint64_t slash8[4], slash16[4], slash24[4];
+    double now = FILE_TIME;
+    double rise = 1.0;
 
     glViewport(0, 0, MAPWIDTH, MAPHEIGHT);
     glScissor(0, 0, MAPWIDTH, MAPHEIGHT);
@@ -530,49 +1458,54 @@ drawData()
     glPointSize(POINT_SIZE);
 
     CENTER_IP = ip_from_map_xy((1.0 - TRANS_X) * _32KD, (1.0 + TRANS_Y) * _32KD);
-    NPIX = 0;
-
-    for (dq.a = 0; dq.a < 256; dq.a++) {
-	if (!DATA[dq.a])
-	    continue;
+    data_quiescent();
+    /*
+     * Both renderers keep what they drew last frame, with the decay since
+     * then applied as they draw, so only the /24s written since need to
+     * be looked at again
+     */
+    if (RENDER_POINTS == OPT_RENDER)
+	rise = 1.0 / decay_factor(now - points_begin(now));
+    data_changed(0, 0, slash8);
+    DATA_FOREACH(slash8, dq.a) {
 	dq.b = dq.c = dq.d = 0;
-	if (box1_is_outside_box2(bbox_from_int_slash(ip_from_dq(dq), 8), WINDOW))
-	    continue;
-	for (dq.b = 0; dq.b < 256; dq.b++) {
-	    if (!DATA[dq.a][dq.b])
-		continue;
+	data_changed(ip_from_dq(dq), 8, slash16);
+	DATA_FOREACH(slash16, dq.b) {
 	    dq.c = dq.d = 0;
-	    if (box1_is_outside_box2(bbox_from_int_slash(ip_from_dq(dq), 16), WINDOW))
-		continue;
-	    for (dq.c = 0; dq.c < 256; dq.c++) {
-		if (!DATA[dq.a][dq.b][dq.c])
-		    continue;
+	    data_changed(ip_from_dq(dq), 16, slash24);
+	    DATA_FOREACH(slash24, dq.c) {
+		DATA_TYPE *P;
+		DATA_TYPE D[256];
+		uint64_t cells[4];
+		float *V;
+		data_meta *m;
+		double stamp;
+		double decay;
 		dq.d = 0;
-		if (box1_is_outside_box2(bbox_from_int_slash(ip_from_dq(dq), 24), WINDOW))
+		if (RENDER_TILES == OPT_RENDER) {
+		    tiles_update(ip_from_dq(dq), now);
+		    continue;
+		}
+		if (0 == (P = data_page(ip_from_dq(dq), &m)) || !m->live) {
+		    points_drop(ip_from_dq(dq));
 		    continue;
-		for (dq.d = 0; dq.d < 256; dq.d++) {
-		    unsigned int x, y;
-		    DATA_TYPE v = DATA[dq.a][dq.b][dq.c][dq.d];
-		    if (0 == v)
-			continue;
-		    if (0 == xy_from_ip(ip_from_dq(dq), &x, &y)) {
-			fprintf(stderr, "failed to convert ip %u.%u.%u.%u to X,Y\n", dq.a, dq.b, dq.c, dq.d);
-			continue;
-		    }
-		    double hue = 240.0 * (256.0 - v) / 256.0;
-		    HUE_TO_RGB(hue, R, G, B);
-		    if (R0 != R || G0 != G || B0 != B) {
-			glEnd();
-			glColor4f(R0 = R, G0 = G, B0 = B, v > FADE_START ? (GLfloat) v : (GLfloat) v / FADE_START);
-			glBegin(GL_POINTS);
-		    }
-		    glVertex2f(x, y);
-		    NPIX++;
+		}
+		data_read(P, m, D, cells, &stamp);
+		if (0 == (V = points_block(ip_from_dq(dq), cells)))
+		    continue;
+		decay = decay_factor(now - stamp);
+		DATA_FOREACH(cells, dq.d) {
+		    double v = DATA_VALUE(D[dq.d]) * decay;
+		    *V++ = v < DECAY_FLOOR ? 0.0 : v * rise;
 		}
 	    }
 	}
     }
-    glEnd();
+    if (RENDER_TILES == OPT_RENDER)
+	tiles_draw(WINDOW, ZOOM_SCALE * MAX(MAPWIDTH, MAPHEIGHT) / (double)_64K, now);
+    data_offline();
+    if (RENDER_POINTS == OPT_RENDER)
+	NPIX = points_draw(WINDOW, now);
 }
 
 void
@@ -686,6 +1619,10 @@ drawText(void)
 {
     char tbuf[256];
     time_t theTime = FILE_TIME;
+    unsigned long pages;
+    size_t bytes;
+    unsigned int ntiles;
+    int level;
     glColor3f(0.7, 0.7, 0.7);
     unsigned int n = 1;
     int TW, TH;
@@ -706,9 +1643,18 @@ drawText(void)
     strftime(tbuf, sizeof(tbuf), "%Y-%m-%d %H:%M:%S", gmtime(&theTime));
     drawStr(5, n++ * 15, "File time      %s", tbuf);
     drawStr(5, n++ * 15, "NQUERY         %12u", NQUERY);
-    drawStr(5, n++ * 15, "NPIX           %12u", NPIX);
+    if (RENDER_TILES == OPT_RENDER) {
+	tiles_stats(&ntiles, &level);
+	drawStr(5, n++ * 15, "TILES          %9u/L%d", ntiles, level);
+    } else {
+	drawStr(5, n++ * 15, "NPIX           %12u", NPIX);
+    }
     drawStr(5, n++ * 15, "QPS            %12.2f", QPS);
     drawStr(5, n++ * 15, "DRAW TIME      %12.3f", DRAW_TIME);
+    drawStr(5, n++ * 15, "DECAY TIME     %12.3f", DECAY_TIME);
+    data_stats(&pages, &bytes);
+    drawStr(5, n++ * 15, "PAGES          %12lu", pages);
+    drawStr(5, n++ * 15, "MEMORY         %10.1fMB", bytes / 1048576.0);
     drawStr(5, n++ * 15, "POINT SCALE    %12.3f", POINT_SCALE);
     drawStr(5, n++ * 15, "POINT SIZE     %12.3f", POINT_SIZE);
     n++;
@@ -722,6 +1668,14 @@ drawText(void)
     drawStr(5, n++ * 15, "Cursor         %u.%u.%u.%u", CURSOR_IP.a, CURSOR_IP.b, CURSOR_IP.c, CURSOR_IP.d);
     drawStr(5, n++ * 15, "Window         %d,%d", CURSOR_X, CURSOR_Y);
     drawStr(5, n++ * 15, "Map X,Y        %7.1f,%7.1f", MAP_X, MAP_Y);
+    if (NSOURCES) {
+	unsigned int i;
+	n++;
+	drawStr(5, n++ * 15, "%s", "Sources                      NQUERY         QPS     LOST");
+	for (i = 0; i < NSOURCES; i++)
+	    drawStr(5, n++ * 15, "%-25s %10u %11.2f %8u%s", SOURCES[i].name, SOURCES[i].nquery, SOURCES[i].qps,
+		SOURCES[i].lost + SOURCES[i].kdrops, SOURCES[i].fd < 0 ? " closed" : "");
+    }
 }
 
 GLfloat
@@ -941,9 +1895,11 @@ cb_Key(unsigned char c, int x, int y)
 	HALF_LIFE -= 1.0;
 	if (HALF_LIFE < 0.0)
 	    HALF_LIFE = 0.0;
+	half_life_changed();
 	break;
     case 'D':
 	HALF_LIFE += 1.0;
+	half_life_changed();
 	break;
     case 's':
 	FILE_TIME_OFFSET = 0;
@@ -967,67 +1923,179 @@ cb_Key(unsigned char c, int x, int y)
 void
 cb_Idle(void)
 {
-    static double FILE_TIME_LAST_DECAY = 0;
     NOW = glutGet(GLUT_ELAPSED_TIME);
     if ((NOW - TIMEBASE) > 10) {
 	glutPostRedisplay();
     } else {
 	usleep(10000);
     }
-    if (HALF_LIFE > 0.0 && FILE_TIME - FILE_TIME_LAST_DECAY >= 0.01) {
-	decayData(pow(2.0, -1.0 * (FILE_TIME - FILE_TIME_LAST_DECAY) / HALF_LIFE ));
-	FILE_TIME_LAST_DECAY = FILE_TIME;
-    }
 }
 
+/*
+ * Decay worker.  Every DECAY_PERIOD or so it walks the live pages,
+ * rescaling and restamping those a good way towards a half-life old so
+ * that writers seldom have to, and clearing those that have faded out
+ * completely.  It also carries out the 'h' key.  The renderer copies each
+ * page with data_read(), which retries if the worker rescaled the page
+ * meanwhile, and decays every page to the same file time, so a frame is a
+ * consistent snapshot however long it takes to draw.  Restamping leaves
+ * what a page reads back as alone, so only halving and clearing a page
+ * mark it for the renderer.  Pages left with nothing in them are retired,
+ * and freed by data_reclaim() once no thread can still be using them.
+ *
+ * With -j the sweep is shared with OPT_THREADS - 1 helper threads, which
+ * take occupied /8s in turn from SWEEP.next.  Nothing a sweep touches is
+ * shared between /8s except through atomics (and data_retire() puts
+ * things in limbo under a lock), so they need no other coordination.  The
+ * worker waits for the helpers before reclaiming, so nothing they can
+ * still see is freed under them.
+ *
+ * Writers and the sweep stay apart with the per-page lock rather than by
+ * updating cells atomically: a rescale rewrites the whole page and its
+ * stamp together, which a writer must not see half done, and an
+ * uncontended lock costs a writer no more than an atomic add would.
+ */
+static struct {
+    unsigned char slash8[256];	/* occupied /8s */
+    unsigned int n;
+    unsigned int next;		/* next of slash8[] to take */
+    unsigned int round;		/* bumped to start each sweep */
+    unsigned int done;		/* helpers finished with this one */
+    double now;
+    double f;
+} SWEEP;
+static pthread_mutex_t mutexSweep = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t condSweep = PTHREAD_COND_INITIALIZER;
+
 void
-decayData(double decay)
+decay_slash8(unsigned int a, double now, double f)
 {
-    dq dq;
-    for (dq.a = 0; dq.a < 256; dq.a++) {
-	if (!DATA[dq.a])
-	    continue;
-	for (dq.b = 0; dq.b < 256; dq.b++) {
-	    if (!DATA[dq.a][dq.b])
+    dq dq = {a, 0, 0, 0};
+    uint64_t slash16[4], slash24[4];
+    data_children(ip_from_dq(dq), 8, slash16);
+    DATA_FOREACH(slash16, dq.b) {
+	dq.c = 0;
+	data_children(ip_from_dq(dq), 16, slash24);
+	DATA_FOREACH(slash24, dq.c) {
+	    data_meta *m;
+	    DATA_TYPE *D = data_page(ip_from_dq(dq), &m);
+	    double decay;
+	    if (!D)
 		continue;
-	    for (dq.c = 0; dq.c < 256; dq.c++) {
-		if (!DATA[dq.a][dq.b][dq.c])
-		    continue;
-		for (dq.d = 0; dq.d < 256; dq.d++) {
-		    if (DATA[dq.a][dq.b][dq.c][dq.d]) {
-			DATA[dq.a][dq.b][dq.c][dq.d] *= decay;
-		    }
+	    data_lock(m);
+	    if (m->live) {
+		decay = decay_factor(now - m->stamp);
+		if (DATA_VALUE(DATA_CELL_MAX) * decay < DECAY_FLOOR) {
+		    data_rescale(D, m, 0.0, now);
+		    data_dirty(ip_from_dq(dq));
+		} else if (f < 1.0 || decay <= 1.0 / DECAY_RESCALE) {
+		    data_rescale(D, m, f * decay, now > m->stamp ? now : m->stamp);
+		    if (f < 1.0)
+			data_dirty(ip_from_dq(dq));
 		}
 	    }
+	    if (!m->live)
+		data_retire(ip_from_dq(dq), m);
+	    data_unlock(m);
 	}
     }
-    glEnd();
+}
+
+/*
+ * Take /8s from the current sweep until there are none left
+ */
+void
+decay_share(void)
+{
+    unsigned int k;
+    while ((k = __atomic_fetch_add(&SWEEP.next, 1, __ATOMIC_RELAXED)) < SWEEP.n)
+	decay_slash8(SWEEP.slash8[k], SWEEP.now, SWEEP.f);
+}
+
+void *
+decay_helper(void *unused)
+{
+    unsigned int round = 0;
+    pthread_mutex_lock(&mutexSweep);
+    for (;;) {
+	while (round == SWEEP.round)
+	    pthread_cond_wait(&condSweep, &mutexSweep);
+	round = SWEEP.round;
+	pthread_mutex_unlock(&mutexSweep);
+	decay_share();
+	pthread_mutex_lock(&mutexSweep);
+	SWEEP.done++;
+	pthread_cond_broadcast(&condSweep);
+    }
+    return 0;
+}
+
+void
+decay_sweep(double now, double f)
+{
+    uint64_t slash8[4];
+    unsigned int a;
+    SWEEP.n = 0;
+    data_children(0, 0, slash8);
+    DATA_FOREACH(slash8, a)
+	SWEEP.slash8[SWEEP.n++] = a;
+    SWEEP.next = 0;
+    SWEEP.now = now;
+    SWEEP.f = f;
+    pthread_mutex_lock(&mutexSweep);
+    SWEEP.done = 0;
+    SWEEP.round++;
+    pthread_cond_broadcast(&condSweep);
+    pthread_mutex_unlock(&mutexSweep);
+    decay_share();
+    pthread_mutex_lock(&mutexSweep);
+    while (SWEEP.done < OPT_THREADS - 1)
+	pthread_cond_wait(&condSweep, &mutexSweep);
+    pthread_mutex_unlock(&mutexSweep);
+}
+
+void *
+decay_main(void *unused)
+{
+    pthread_t helper;
+    unsigned int i;
+    for (i = 1; i < OPT_THREADS; i++)
+	pthread_create(&helper, 0, decay_helper, 0);
+    for (;;) {
+	struct timeval t0;
+	struct timeval t1;
+	double f = __atomic_exchange_n(&HALVE, 0, __ATOMIC_ACQ_REL) ? 0.5 : 1.0;
+	gettimeofday(&t0, 0);
+	decay_sweep(FILE_TIME, f);
+	data_reclaim();
+	gettimeofday(&t1, 0);
+	DECAY_TIME = (t1.tv_sec - t0.tv_sec) + 0.000001 * (t1.tv_usec - t0.tv_usec);
+	/* on a big map, keep the worker to a fraction of a core */
+	usleep(DECAY_PERIOD + 3000000 * DECAY_TIME);
+    }
+    return 0;
 }
 
 void
 decayByHalf()
 {
-    dq dq;
-    for (dq.a = 0; dq.a < 256; dq.a++) {
-	if (!DATA[dq.a])
-	    continue;
-	for (dq.b = 0; dq.b < 256; dq.b++) {
-	    if (!DATA[dq.a][dq.b])
-		continue;
-	    for (dq.c = 0; dq.c < 256; dq.c++) {
-		if (!DATA[dq.a][dq.b][dq.c])
-		    continue;
-		for (dq.d = 0; dq.d < 256; dq.d++) {
-		    if (DATA[dq.a][dq.b][dq.c][dq.d])
-#if DATA_DOUBLES
-			DATA[dq.a][dq.b][dq.c][dq.d] /= 2.0;
-#else
-			DATA[dq.a][dq.b][dq.c][dq.d] >>= 1;
-#endif
-		}
-	    }
-	}
+    __atomic_store_n(&HALVE, 1, __ATOMIC_RELEASE);
+}
+
+/*
+ * What the renderer keeps is decayed with the HALF_LIFE it was made
+ * with.  Tiles are rebuilt a few at a time; points are all rewritten.
+ */
+void
+half_life_changed()
+{
+    if (RENDER_TILES == OPT_RENDER) {
+	tiles_invalidate();
+	return;
     }
+    data_quiescent();
+    data_dirty_all();
+    data_offline();
 }
 
 void
@@ -1037,9 +2105,12 @@ open_stream(const char *arg)
     int s;
     struct sockaddr_in S;
     char hello[12];
-    int x;
+    int flags;
     if (0 == t)
-	err(1, "bad stream '%s'", arg);
+	errx(1, "bad stream '%s'", arg);
+    if (NSOURCES == MAX_SOURCES)
+	errx(1, "too many streams (max %d)", MAX_SOURCES);
+    SOURCES[NSOURCES].name = strdup(arg);
     *t = 0;
     memset(&S, 0, sizeof(S));
     S.sin_family = AF_INET;
@@ -1050,19 +2121,60 @@ open_stream(const char *arg)
 	err(1, "socket");
     if (connect(s, (struct sockaddr *)&S, sizeof(S)) < 0)
 	err(1, "connect %s", arg);
-    /*
-     * if ((flags = fcntl(s, F_GETFL, flags)) < 0) err(1, "fcntl F_GETFL"); if
-     * (fcntl(s, F_SETFL, flags | O_NONBLOCK) < 0) err(1, "fcntl F_SETFL");
-     */
-    STREAM = s;
-    x = read(s, hello, 12);
-    fprintf(stderr, "read hello %d bytes\n", x);
-    fprintf(stderr, "read hello '%s'\n", hello);
-    if (0 == memcmp(hello, "HELLO THERE!", 12)) {
-	fprintf(stderr, "connected, hello received\n");
+    if (12 != blocking_read(s, hello, 12) || 0 != memcmp(hello, "HELLO THERE!", 12))
+	errx(1, "bad hello from %s", arg);
+    fprintf(stderr, "connected, hello received\n");
+    if ((flags = fcntl(s, F_GETFL, 0)) < 0)
+	err(1, "fcntl F_GETFL");
+    if (fcntl(s, F_SETFL, flags | O_NONBLOCK) < 0)
+	err(1, "fcntl F_SETFL");
+    SOURCES[NSOURCES++].fd = s;
+}
+
+/*
+ * Listen for datagram input on [ip:]port
+ */
+void
+open_udp(const char *arg)
+{
+    char *t = strchr(arg, ':');
+    int s;
+    struct sockaddr_in S;
+    int on = 1;
+    int rcvbuf = UDP_RCVBUF;
+    int flags;
+    char name[64];
+    if (NSOURCES == MAX_SOURCES)
+	errx(1, "too many streams (max %d)", MAX_SOURCES);
+    memset(&S, 0, sizeof(S));
+    S.sin_family = AF_INET;
+    S.sin_addr.s_addr = INADDR_ANY;
+    if (t) {
+	*t++ = 0;
+	S.sin_addr.s_addr = inet_addr(arg);
     } else {
-	err(1, "bad hello");
+	t = (char *)arg;
     }
+    S.sin_port = htons(atoi(t));
+    s = socket(PF_INET, SOCK_DGRAM, 0);
+    if (s < 0)
+	err(1, "socket");
+    setsockopt(s, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    if (setsockopt(s, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf)) < 0)
+	warn("SO_RCVBUF");
+#if defined(SO_RXQ_OVFL)
+    setsockopt(s, SOL_SOCKET, SO_RXQ_OVFL, &on, sizeof(on));
+#endif
+    if (bind(s, (struct sockaddr *)&S, sizeof(S)) < 0)
+	err(1, "bind udp %s", t);
+    if ((flags = fcntl(s, F_GETFL, 0)) < 0)
+	err(1, "fcntl F_GETFL");
+    if (fcntl(s, F_SETFL, flags | O_NONBLOCK) < 0)
+	err(1, "fcntl F_SETFL");
+    snprintf(name, sizeof(name), "udp/%s:%u", inet_ntoa(S.sin_addr), ntohs(S.sin_port));
+    SOURCES[NSOURCES].name = strdup(name);
+    SOURCES[NSOURCES].udp = 1;
+    SOURCES[NSOURCES++].fd = s;
 }
 
 int
@@ -1075,17 +2187,41 @@ main(int argc, char *argv[])
 
     memset(OPT_BREAKPOINTS, 0, sizeof(OPT_BREAKPOINTS));
 
-    while ((ch = getopt(argc, argv, "ad:p:s:uFm:b:X:Y:Z:")) != -1) {
+    while ((ch = getopt(argc, argv, "aBC:d:f:j:p:P:R:s:S:uU:VFm:b:X:Y:Z:")) != -1) {
 	switch (ch) {
 	case 'a':
 	    OPT_AUTO_POINT_SIZE = 1;
 	    break;
+	case 'B':
+	    OPT_INPUT_BINARY = 1;
+	    break;
+	case 'C':
+	    if (0 == strcmp(optarg, "morton"))
+		set_morton_mode();
+	    else if (0 != strcmp(optarg, "hilbert"))
+		errx(1, "-C takes hilbert or morton");
+	    break;
 	case 'd':
 	    HALF_LIFE = strtod(optarg, 0);
 	    break;
+	case 'f':
+	    map_input(optarg);
+	    break;
+	case 'j':
+	    OPT_THREADS = strtoul(optarg, 0, 0);
+	    if (OPT_THREADS < 1 || OPT_THREADS > MAX_SHARDS)
+		errx(1, "-j must be between 1 and %d", MAX_SHARDS);
+	    break;
 	case 'p':
 	    POINT_SCALE = strtod(optarg, 0);
 	    break;
+	case 'P':
+	    OPT_INPUT_PCAP = 1;
+	    if (0 == strcmp(optarg, "dst"))
+		OPT_PCAP_DST = 1;
+	    else if (0 != strcmp(optarg, "src"))
+		errx(1, "-P takes src or dst");
+	    break;
 	case 'b':
 	    if (BREAKPOINT_IDX < 99) {
 		OPT_BREAKPOINTS[BREAKPOINT_IDX] = strtoul(optarg, 0, 0);
@@ -1095,9 +2231,31 @@ main(int argc, char *argv[])
 	case 's':
 	    open_stream(optarg);
 	    break;
+	case 'R':
+	    if (0 == strcmp(optarg, "tiles"))
+		OPT_RENDER = RENDER_TILES;
+	    else if (0 == strcmp(optarg, "points"))
+		OPT_RENDER = RENDER_POINTS;
+	    else
+		errx(1, "-R takes tiles or points");
+	    break;
+	case 'S':
+	    if (0 == strcmp(optarg, "flat"))
+		OPT_STORAGE = DATA_FLAT;
+	    else if (0 == strcmp(optarg, "trie"))
+		OPT_STORAGE = DATA_TRIE;
+	    else
+		errx(1, "-S takes trie or flat");
+	    break;
 	case 'u':
 	    OPT_INPUT_UNTIMED = 1;
 	    break;
+	case 'U':
+	    open_udp(optarg);
+	    break;
+	case 'V':
+	    OPT_INPUT_VALUE = 1;
+	    break;
 	case 'F':
 	    OPT_FULLSCREEN = 1;
 	    break;
@@ -1118,7 +2276,7 @@ main(int argc, char *argv[])
 	    ZOOM_SCALE = zoom_scale();
 	    break;
 	default:
-	    fprintf(stderr, "usage: %s [-a] [-d half-life] [-p pointscale] [-b breakpoint] [-s stream] [-u] [-F] [-m keep/set]\n", prog);
+	    fprintf(stderr, "usage: %s [-a] [-B [-V]] [-C hilbert|morton] [-d half-life] [-f file] [-j threads] [-p pointscale] [-P src|dst] [-R tiles|points] [-b breakpoint] [-s stream] [-S trie|flat] [-U [ip:]port] [-u] [-F] [-m keep/set]\n", prog);
 	    exit(1);
 	    break;
 	}
@@ -1128,7 +2286,7 @@ main(int argc, char *argv[])
 
     BREAKPOINT_IDX = 0;
 
-    DATA = calloc(256, sizeof(***DATA));
+    data_init(OPT_STORAGE);
     set_bits_per_pixel(0);
     set_order();
     srand48((int)time(NULL));
@@ -1160,8 +2318,14 @@ main(int argc, char *argv[])
     //glHint(GL_PERSPECTIVE_CORRECTION_HINT, GL_NICEST);
     glEnable(GL_BLEND);
     glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    points_init(FADE_START);
+    if (RENDER_TILES == OPT_RENDER && !tiles_init(DECAY_FLOOR)) {
+	warnx("tiles need GL 2.0 and R32F textures; drawing points (-R points)");
+	OPT_RENDER = RENDER_POINTS;
+    }
 
     pthread_create(&threadReadData, 0, read_input, 0);
+    pthread_create(&threadDecay, 0, decay_main, 0);
     //pthread_create(&threadViewUpdate, 0, view_update, 0);
     glutMainLoop();
     pthread_join(threadReadData, 0);
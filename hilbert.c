@@ -26,36 +26,145 @@
  * herein.
  */
 
-void
-hil_xy_from_s(unsigned s, int order, unsigned *xp, unsigned *yp)
+#include <stdint.h>
+
+/*
+ * The loops below walk the curve a level (two bits of s) at a time
+ * through a four-state machine.  hil_init() runs them over every state
+ * and every byte, so that the conversions can take four levels per step
+ * by table lookup.  A curve whose order is not a multiple of four is
+ * treated as having up to three extra levels of leading zeros; each
+ * such level flips the state between 0 and 1, so starting from state 1
+ * when their number is odd reaches the top real level in state 0.
+ */
+static unsigned short HIL_XY[4][256];	/* x nibble, y nibble << 4, state << 8 */
+static unsigned short HIL_S[4][256];	/* by x nibble << 4 | y nibble: s byte, state << 8 */
+
+static void
+hil_xy_from_s_bits(unsigned s, int order, unsigned *state, unsigned *xp, unsigned *yp)
 {
 
     int i;
-    unsigned state, x, y, row;
+    unsigned x, y, row;
 
-    state = 0;			/* Initialize. */
     x = y = 0;
 
     for (i = 2 * order - 2; i >= 0; i -= 2) {	/* Do n times. */
-	row = 4 * state | ((s >> i) & 3);	/* Row in table. */
+	row = 4 * *state | ((s >> i) & 3);	/* Row in table. */
 	x = (x << 1) | ((0x936C >> row) & 1);
 	y = (y << 1) | ((0x39C6 >> row) & 1);
-	state = (0x3E6B94C1 >> 2 * row) & 3;	/* New state. */
+	*state = (0x3E6B94C1 >> 2 * row) & 3;	/* New state. */
     }
     *xp = x;			/* Pass back */
     *yp = y;			/* results. */
 }
 
-
-void
-hil_s_from_xy(unsigned int x, unsigned int y, int order, unsigned int *s)
+static void
+hil_s_from_xy_bits(unsigned int x, unsigned int y, int order, unsigned *state, unsigned int *s)
 {
   int i = 0;
-  unsigned int state = 0;
   unsigned int row;
+  *s = 0;
   for (i = order - 1; i >= 0; i--) {
-    row = (4*state) | (2*((x >> i)&1)) | ((y >> i)&1);
+    row = (4 * *state) | (2*((x >> i)&1)) | ((y >> i)&1);
     *s = (*s<<2) | ((0x361E9CB4 >> (2*row)) & 3);
-    state = (0x8FE65831 >> (2*row)) & 3;
+    *state = (0x8FE65831 >> (2*row)) & 3;
   }
 }
+
+void
+hil_init(void)
+{
+    unsigned state, b;
+    for (state = 0; state < 4; state++) {
+	for (b = 0; b < 256; b++) {
+	    unsigned st = state;
+	    unsigned x, y, s;
+	    hil_xy_from_s_bits(b, 4, &st, &x, &y);
+	    HIL_XY[state][b] = x | y << 4 | st << 8;
+	    st = state;
+	    hil_s_from_xy_bits(b >> 4, b & 15, 4, &st, &s);
+	    HIL_S[state][b] = s | st << 8;
+	}
+    }
+}
+
+void
+hil_xy_from_s(unsigned s, int order, unsigned *xp, unsigned *yp)
+{
+    int levels = (order + 3) & ~3;
+    unsigned state = (levels - order) & 1;
+    unsigned x = 0;
+    unsigned y = 0;
+    unsigned e;
+    int i;
+    if (order < 16)
+	s &= (1u << 2 * order) - 1;
+    for (i = 2 * levels - 8; i >= 0; i -= 8) {
+	e = HIL_XY[state][(s >> i) & 0xFF];
+	x = (x << 4) | (e & 15);
+	y = (y << 4) | ((e >> 4) & 15);
+	state = e >> 8;
+    }
+    *xp = x;
+    *yp = y;
+}
+
+/*
+ * The coordinates of every index in the block of 256 starting at 's'
+ * whose low byte is set in 'cells', in order, for order 4 or more.  The
+ * levels above the last four are the same for the whole block, so they
+ * are walked once and each index costs one lookup.  Returns the number
+ * of coordinates stored.
+ */
+unsigned
+hil_xy_from_s_block(unsigned s, int order, const uint64_t cells[4], unsigned *xp, unsigned *yp)
+{
+    int levels = (order + 3) & ~3;
+    unsigned state = (levels - order) & 1;
+    unsigned x = 0;
+    unsigned y = 0;
+    unsigned n = 0;
+    unsigned e;
+    uint64_t m;
+    int i;
+    if (order < 16)
+	s &= (1u << 2 * order) - 1;
+    for (i = 2 * levels - 8; i > 0; i -= 8) {
+	e = HIL_XY[state][(s >> i) & 0xFF];
+	x = (x << 4) | (e & 15);
+	y = (y << 4) | ((e >> 4) & 15);
+	state = e >> 8;
+    }
+    x <<= 4;
+    y <<= 4;
+    for (i = 0; i < 4; i++) {
+	for (m = cells[i]; m; m &= m - 1) {
+	    e = HIL_XY[state][i * 64 + __builtin_ctzll(m)];
+	    xp[n] = x | (e & 15);
+	    yp[n] = y | ((e >> 4) & 15);
+	    n++;
+	}
+    }
+    return n;
+}
+
+void
+hil_s_from_xy(unsigned int x, unsigned int y, int order, unsigned int *s)
+{
+    int levels = (order + 3) & ~3;
+    unsigned state = (levels - order) & 1;
+    unsigned r = 0;
+    unsigned e;
+    int i;
+    if (order < 16) {
+	x &= (1u << order) - 1;
+	y &= (1u << order) - 1;
+    }
+    for (i = levels - 4; i >= 0; i -= 4) {
+	e = HIL_S[state][((x >> i) & 15) << 4 | ((y >> i) & 15)];
+	r = (r << 8) | (e & 0xFF);
+	state = e >> 8;
+    }
+    *s = r;
+}
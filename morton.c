@@ -0,0 +1,196 @@
+// glheatmap -- OpenGL-based interactive IPv4 heatmap
+//
+// Copyright (C) 2016 Verisign, Inc.
+//
+//  This file is part of glheatmap.
+//
+//  glheatmap is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  glheatmap is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with glheatmap  If not, see <http://www.gnu.org/licenses/>.
+//
+
+/*
+ * Morton (Z-order) curve.
+ *
+ * Each two bits of s, from the top, pick the quadrant of the square at
+ * that level: the high bit is the x bit and the low bit the y bit, so x
+ * is just the odd bits of s and y the even ones.  The layout is less
+ * tidy than Hilbert's, since consecutive addresses can be far apart, but
+ * an aligned prefix is still an aligned square, and conversion is a
+ * couple of bit gathers.  Where the CPU has BMI2, pext and pdep do each
+ * coordinate in one instruction; otherwise the bits are spread and
+ * squashed with masks.  Some CPUs with BMI2 (AMD before Zen 3) run pext
+ * and pdep in microcode, far slower than the masks, so mor_init() times
+ * both and keeps the faster.
+ */
+
+#include <stdint.h>
+#include <sys/time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define MOR_X86 1
+#endif
+
+#define MOR_X 0xAAAAAAAAu
+#define MOR_Y 0x55555555u
+#define MOR_TRIALS 3		/* timings of each path, best kept */
+#define MOR_ROUNDS 65536	/* round trips per timing */
+
+static int MOR_BMI2 = 0;
+static volatile unsigned MOR_SINK;	/* keeps mor_time()'s work */
+static unsigned char MOR_XY[256];	/* x nibble, y nibble << 4 */
+
+/*
+ * The even bits of 'v', packed into its low half
+ */
+static unsigned
+mor_squash(unsigned v)
+{
+    v &= 0x55555555;
+    v = (v | (v >> 1)) & 0x33333333;
+    v = (v | (v >> 2)) & 0x0F0F0F0F;
+    v = (v | (v >> 4)) & 0x00FF00FF;
+    v = (v | (v >> 8)) & 0x0000FFFF;
+    return v;
+}
+
+/*
+ * The low half of 'v' spread onto the even bits
+ */
+static unsigned
+mor_spread(unsigned v)
+{
+    v &= 0x0000FFFF;
+    v = (v | (v << 8)) & 0x00FF00FF;
+    v = (v | (v << 4)) & 0x0F0F0F0F;
+    v = (v | (v << 2)) & 0x33333333;
+    v = (v | (v << 1)) & 0x55555555;
+    return v;
+}
+
+#ifdef MOR_X86
+__attribute__((target("bmi2")))
+static void
+mor_xy_from_s_bmi2(unsigned s, unsigned *xp, unsigned *yp)
+{
+    *xp = _pext_u32(s, MOR_X);
+    *yp = _pext_u32(s, MOR_Y);
+}
+
+__attribute__((target("bmi2")))
+static unsigned
+mor_s_from_xy_bmi2(unsigned x, unsigned y)
+{
+    return _pdep_u32(x, MOR_X) | _pdep_u32(y, MOR_Y);
+}
+#endif
+
+void
+mor_xy_from_s(unsigned s, int order, unsigned *xp, unsigned *yp)
+{
+    if (order < 16)
+	s &= (1u << 2 * order) - 1;
+#ifdef MOR_X86
+    if (MOR_BMI2) {
+	mor_xy_from_s_bmi2(s, xp, yp);
+	return;
+    }
+#endif
+    *xp = mor_squash(s >> 1);
+    *yp = mor_squash(s);
+}
+
+/*
+ * As hil_xy_from_s_block(): the coordinates of every index in the block
+ * of 256 starting at 's' whose low byte is set in 'cells', in order.
+ * Returns the number stored.
+ */
+unsigned
+mor_xy_from_s_block(unsigned s, int order, const uint64_t cells[4], unsigned *xp, unsigned *yp)
+{
+    unsigned x, y;
+    unsigned n = 0;
+    uint64_t m;
+    int i;
+    mor_xy_from_s(s & ~0xFFu, order, &x, &y);
+    for (i = 0; i < 4; i++) {
+	for (m = cells[i]; m; m &= m - 1) {
+	    unsigned e = MOR_XY[i * 64 + __builtin_ctzll(m)];
+	    xp[n] = x | (e & 15);
+	    yp[n] = y | (e >> 4);
+	    n++;
+	}
+    }
+    return n;
+}
+
+void
+mor_s_from_xy(unsigned x, unsigned y, int order, unsigned *s)
+{
+    if (order < 16) {
+	x &= (1u << order) - 1;
+	y &= (1u << order) - 1;
+    }
+#ifdef MOR_X86
+    if (MOR_BMI2) {
+	*s = mor_s_from_xy_bmi2(x, y);
+	return;
+    }
+#endif
+    *s = mor_spread(x) << 1 | mor_spread(y);
+}
+
+#ifdef MOR_X86
+/*
+ * Seconds taken by MOR_ROUNDS round trips through the path selected by
+ * MOR_BMI2
+ */
+static double
+mor_time(void)
+{
+    struct timeval t0, t1;
+    unsigned x, y, s = 0;
+    unsigned k;
+    gettimeofday(&t0, 0);
+    for (k = 0; k < MOR_ROUNDS; k++) {
+	mor_xy_from_s(k * 2654435761u ^ s, 16, &x, &y);
+	mor_s_from_xy(x, y, 16, &s);
+    }
+    gettimeofday(&t1, 0);
+    MOR_SINK = s;
+    return (t1.tv_sec - t0.tv_sec) + 0.000001 * (t1.tv_usec - t0.tv_usec);
+}
+#endif
+
+void
+mor_init(void)
+{
+    unsigned b;
+#ifdef MOR_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("bmi2")) {
+	double best[2] = {1e9, 1e9};
+	int i;
+	for (i = 0; i < 2 * MOR_TRIALS; i++) {
+	    double t;
+	    MOR_BMI2 = i & 1;
+	    t = mor_time();
+	    if (t < best[i & 1])
+		best[i & 1] = t;
+	}
+	MOR_BMI2 = best[1] < best[0];
+    }
+#endif
+    for (b = 0; b < 256; b++)
+	MOR_XY[b] = mor_squash(b >> 1) | mor_squash(b) << 4;
+}
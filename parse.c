@@ -0,0 +1,175 @@
+// glheatmap -- OpenGL-based interactive IPv4 heatmap
+//
+// Copyright (C) 2016 Verisign, Inc.
+//
+//  This file is part of glheatmap.
+//
+//  glheatmap is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  glheatmap is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with glheatmap  If not, see <http://www.gnu.org/licenses/>.
+//
+
+/*
+ * Input field parsing.
+ *
+ * These work on a [p, end) range of an input buffer rather than on
+ * NUL-terminated strings, so lines can be parsed in place (even from a
+ * read-only mapping) without strtok, copies or locale-aware libc calls.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "parse.h"
+
+#define IS_SPACE(c) (' ' == (c) || '\t' == (c) || '\r' == (c) || '\n' == (c))
+#define IS_DIGIT(c) ((unsigned char)((c) - '0') < 10)
+
+static const double pow10[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9,
+    1e10, 1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17
+};
+
+/*
+ * Return a pointer to the next newline at or after 'p', or 'end' if there
+ * is none.  Scans 16 bytes at a time where SSE2 is available.
+ */
+const char *
+parse_eol(const char *p, const char *end)
+{
+#if defined(__SSE2__)
+    const __m128i nl = _mm_set1_epi8('\n');
+    while (end - p >= 16) {
+	int m = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)p), nl));
+	if (m)
+	    return p + __builtin_ctz(m);
+	p += 16;
+    }
+#endif
+    while (p < end && '\n' != *p)
+	p++;
+    return p;
+}
+
+const char *
+parse_skip_space(const char *p, const char *end)
+{
+    while (p < end && IS_SPACE(*p))
+	p++;
+    return p;
+}
+
+const char *
+parse_field_end(const char *p, const char *end)
+{
+    while (p < end && !IS_SPACE(*p))
+	p++;
+    return p;
+}
+
+/*
+ * Parse a Unix epoch timestamp with optional fraction from the field
+ * starting at 'p'.  Anything more exotic than [digits][.digits] is handed
+ * to strtod(), so the accepted syntax is the same as before.  Returns the
+ * end of the field, or NULL if no number was found.
+ */
+const char *
+parse_time(const char *p, const char *end, double *t)
+{
+    const char *s = p;
+    unsigned long long i = 0;
+    unsigned long long f = 0;
+    int nf = 0;
+    while (p < end && IS_DIGIT(*p) && p - s < 18)
+	i = i * 10 + (*p++ - '0');
+    if (p < end && '.' == *p) {
+	p++;
+	while (p < end && IS_DIGIT(*p)) {
+	    if (nf < 17) {
+		f = f * 10 + (*p - '0');
+		nf++;
+	    }
+	    p++;
+	}
+    }
+    if ((p == end || IS_SPACE(*p)) && p > s && (p - s > 1 || '.' != *s)) {
+	*t = (double)i + (double)f / pow10[nf];
+	return p;
+    } else {
+	char buf[64];
+	char *e;
+	size_t len;
+	p = parse_field_end(s, end);
+	len = (size_t)(p - s) < sizeof(buf) ? (size_t)(p - s) : sizeof(buf) - 1;
+	memcpy(buf, s, len);
+	buf[len] = '\0';
+	*t = strtod(buf, &e);
+	return e != buf ? p : NULL;
+    }
+}
+
+/*
+ * Parse an IPv4 address field, either as a dotted quad (with the same
+ * rules as inet_pton) or as its integer equivalent.  The result is in
+ * host byte order.  Returns the end of the field, or NULL if it is
+ * neither.
+ */
+const char *
+parse_ip(const char *p, const char *end, unsigned int *ip)
+{
+    const char *s = p;
+    unsigned int a = 0;
+    unsigned int o;
+    int i;
+    while (p < end && IS_DIGIT(*p))
+	a = a * 10 + (*p++ - '0');
+    if (p == s)
+	return NULL;
+    if (p == end || IS_SPACE(*p)) {
+	*ip = a;
+	return p;
+    }
+    /*
+     * Dotted quad; what we have so far is the first octet
+     */
+    if (p - s > 3 || a > 255 || (p - s > 1 && '0' == *s))
+	return NULL;
+    for (i = 1; i < 4; i++) {
+	if (p == end || '.' != *p++)
+	    return NULL;
+	for (s = p, o = 0; p < end && IS_DIGIT(*p) && p - s < 3; p++)
+	    o = o * 10 + (*p - '0');
+	if (p == s || o > 255 || (p - s > 1 && '0' == *s))
+	    return NULL;
+	a = (a << 8) | o;
+    }
+    if (p < end && !IS_SPACE(*p))
+	return NULL;
+    *ip = a;
+    return p;
+}
+
+/*
+ * Parse leading decimal digits, as strtoul(s, NULL, 10) would
+ */
+unsigned long
+parse_ulong(const char *p, const char *end)
+{
+    unsigned long v = 0;
+    while (p < end && IS_DIGIT(*p))
+	v = v * 10 + (*p++ - '0');
+    return v;
+}
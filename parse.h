@@ -0,0 +1,11 @@
+#ifndef PARSE_H
+#define PARSE_H
+
+const char *parse_eol(const char *p, const char *end);
+const char *parse_skip_space(const char *p, const char *end);
+const char *parse_field_end(const char *p, const char *end);
+const char *parse_time(const char *p, const char *end, double *t);
+const char *parse_ip(const char *p, const char *end, unsigned int *ip);
+unsigned long parse_ulong(const char *p, const char *end);
+
+#endif
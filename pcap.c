@@ -0,0 +1,288 @@
+// glheatmap -- OpenGL-based interactive IPv4 heatmap
+//
+// Copyright (C) 2016 Verisign, Inc.
+//
+//  This file is part of glheatmap.
+//
+//  glheatmap is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  glheatmap is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with glheatmap  If not, see <http://www.gnu.org/licenses/>.
+//
+
+/*
+ * Packet capture decoding.
+ *
+ * Reads classic pcap and pcapng records from a [p, end) range of an input
+ * buffer and pulls the IPv4 source and destination addresses straight out
+ * of the packet headers, so captures can be replayed without libpcap or a
+ * tcpdump/tshark text conversion.  Link types understood are Ethernet
+ * (with any number of 802.1Q/802.1ad tags), raw IP, BSD loopback and
+ * Linux cooked capture; packets of any other kind are skipped.
+ */
+
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+
+#include "pcap.h"
+
+#define PCAP_MAGIC_USEC 0xa1b2c3d4
+#define PCAP_MAGIC_NSEC 0xa1b23c4d
+#define PCAPNG_SHB 0x0a0d0d0a
+#define PCAPNG_BOM 0x1a2b3c4d
+#define PCAPNG_IDB 1
+#define PCAPNG_OPB 2		/* obsolete packet block */
+#define PCAPNG_SPB 3
+#define PCAPNG_EPB 6
+#define PCAPNG_OPT_TSRESOL 9
+#define PCAP_MAX_CAPLEN (1 << 26)	/* anything larger is corruption */
+
+#define LINKTYPE_NULL 0
+#define LINKTYPE_ETHERNET 1
+#define LINKTYPE_RAW_OPENBSD 12
+#define LINKTYPE_RAW_BSDOS 14
+#define LINKTYPE_RAW 101
+#define LINKTYPE_LOOP 108
+#define LINKTYPE_LINUX_SLL 113
+#define LINKTYPE_IPV4 228
+#define LINKTYPE_LINUX_SLL2 276
+
+static uint32_t
+get32(const pcap_state *s, const char *p)
+{
+    uint32_t v;
+    memcpy(&v, p, 4);
+    return s->swap ? __builtin_bswap32(v) : v;
+}
+
+static uint16_t
+get16(const pcap_state *s, const char *p)
+{
+    uint16_t v;
+    memcpy(&v, p, 2);
+    return s->swap ? __builtin_bswap16(v) : v;
+}
+
+/*
+ * Packet headers are always in network byte order
+ */
+static uint32_t
+net32(const unsigned char *p)
+{
+    return (uint32_t)p[0] << 24 | p[1] << 16 | p[2] << 8 | p[3];
+}
+
+static unsigned int
+net16(const unsigned char *p)
+{
+    return p[0] << 8 | p[1];
+}
+
+/*
+ * Find the IPv4 header in a captured frame and extract its addresses.
+ * Returns PCAP_PACKET, or PCAP_SKIP if the frame is not IPv4 or is
+ * truncated before the addresses.
+ */
+static int
+decode_frame(unsigned int linktype, const unsigned char *f, unsigned int len, unsigned int *src, unsigned int *dst)
+{
+    unsigned int off;
+    unsigned int type;
+    switch (linktype) {
+    case LINKTYPE_ETHERNET:
+	off = 12;
+	if (len < off + 2)
+	    return PCAP_SKIP;
+	type = net16(f + off);
+	while (0x8100 == type || 0x88a8 == type || 0x9100 == type) {
+	    off += 4;
+	    if (len < off + 2)
+		return PCAP_SKIP;
+	    type = net16(f + off);
+	}
+	if (0x0800 != type)
+	    return PCAP_SKIP;
+	off += 2;
+	break;
+    case LINKTYPE_NULL:
+    case LINKTYPE_LOOP:
+	/*
+	 * AF_INET is 2 everywhere; DLT_NULL stores it in the byte order
+	 * of the capturing host, so accept either
+	 */
+	if (len < 4 || (2 != net32(f) && 0x02000000 != net32(f)))
+	    return PCAP_SKIP;
+	off = 4;
+	break;
+    case LINKTYPE_LINUX_SLL:
+	if (len < 16 || 0x0800 != net16(f + 14))
+	    return PCAP_SKIP;
+	off = 16;
+	break;
+    case LINKTYPE_LINUX_SLL2:
+	if (len < 20 || 0x0800 != net16(f))
+	    return PCAP_SKIP;
+	off = 20;
+	break;
+    case LINKTYPE_RAW:
+    case LINKTYPE_RAW_OPENBSD:
+    case LINKTYPE_RAW_BSDOS:
+    case LINKTYPE_IPV4:
+	off = 0;
+	break;
+    default:
+	return PCAP_SKIP;
+    }
+    if (len < off + 20 || 0x40 != (f[off] & 0xf0) || (f[off] & 0x0f) < 5)
+	return PCAP_SKIP;
+    *src = net32(f + off + 12);
+    *dst = net32(f + off + 16);
+    return PCAP_PACKET;
+}
+
+/*
+ * Recognize the capture format from the start of the file and consume the
+ * classic pcap file header.  A pcapng Section Header Block is left for
+ * pcap_next().  Returns 0, PCAP_MORE or PCAP_BAD.
+ */
+int
+pcap_open(pcap_state *s, const char *p, const char *end, const char **next)
+{
+    uint32_t magic;
+    memset(s, 0, sizeof(*s));
+    if (end - p < 4)
+	return PCAP_MORE;
+    memcpy(&magic, p, 4);
+    if (PCAPNG_SHB == magic) {
+	s->ng = 1;
+	*next = p;
+	return 0;
+    }
+    if (PCAP_MAGIC_USEC != magic && PCAP_MAGIC_NSEC != magic) {
+	magic = __builtin_bswap32(magic);
+	if (PCAP_MAGIC_USEC != magic && PCAP_MAGIC_NSEC != magic)
+	    return PCAP_BAD;
+	s->swap = 1;
+    }
+    if (end - p < 24)
+	return PCAP_MORE;
+    s->nifs = 1;
+    s->ifs[0].linktype = get32(s, p + 20) & 0xffff;
+    s->ifs[0].tsscale = PCAP_MAGIC_NSEC == magic ? 1e9 : 1e6;
+    *next = p + 24;
+    return 0;
+}
+
+/*
+ * Pick if_tsresol out of an Interface Description Block's options
+ */
+static double
+idb_tsscale(const pcap_state *s, const char *p, const char *end)
+{
+    while (end - p >= 4) {
+	unsigned int code = get16(s, p);
+	unsigned int len = get16(s, p + 2);
+	p += 4;
+	if (0 == code || end - p < len)
+	    break;
+	if (PCAPNG_OPT_TSRESOL == code && len >= 1) {
+	    unsigned char r = *p;
+	    return r & 0x80 ? ldexp(1.0, r & 0x7f) : pow(10.0, r);
+	}
+	p += (len + 3) & ~3u;
+    }
+    return 1e6;
+}
+
+/*
+ * Decode the record at 'p'.  On anything but PCAP_MORE or PCAP_BAD, *next
+ * is set past the record.  For PCAP_PACKET the addresses are returned in
+ * host byte order, and *t is set if the record carries a timestamp.
+ */
+int
+pcap_next(pcap_state *s, const char *p, const char *end, const char **next, double *t, unsigned int *src, unsigned int *dst)
+{
+    uint32_t type;
+    uint32_t len;
+    uint32_t caplen;
+    uint32_t ifid;
+    const char *body;
+    if (!s->ng) {
+	if (end - p < 16)
+	    return PCAP_MORE;
+	caplen = get32(s, p + 8);
+	if (caplen > PCAP_MAX_CAPLEN)
+	    return PCAP_BAD;
+	if (end - p - 16 < caplen)
+	    return PCAP_MORE;
+	*next = p + 16 + caplen;
+	if (PCAP_SKIP == decode_frame(s->ifs[0].linktype, (const unsigned char *)p + 16, caplen, src, dst))
+	    return PCAP_SKIP;
+	*t = get32(s, p) + get32(s, p + 4) / s->ifs[0].tsscale;
+	return PCAP_PACKET;
+    }
+    if (end - p < 12)
+	return PCAP_MORE;
+    memcpy(&type, p, 4);
+    if (PCAPNG_SHB == type) {
+	uint32_t bom;
+	memcpy(&bom, p + 8, 4);
+	if (PCAPNG_BOM == bom)
+	    s->swap = 0;
+	else if (PCAPNG_BOM == __builtin_bswap32(bom))
+	    s->swap = 1;
+	else
+	    return PCAP_BAD;
+	s->nifs = 0;
+    }
+    type = get32(s, p);
+    len = get32(s, p + 4);
+    if (len < 12 || (len & 3) || len > PCAP_MAX_CAPLEN)
+	return PCAP_BAD;
+    if (end - p < len)
+	return PCAP_MORE;
+    *next = p + len;
+    body = p + 8;
+    len -= 12;
+    switch (type) {
+    case PCAPNG_IDB:
+	if (len < 8 || PCAP_MAX_IFS == s->nifs)
+	    return PCAP_SKIP;
+	s->ifs[s->nifs].linktype = get16(s, body);
+	s->ifs[s->nifs].tsscale = idb_tsscale(s, body + 8, body + len);
+	s->nifs++;
+	return PCAP_SKIP;
+    case PCAPNG_EPB:
+    case PCAPNG_OPB:
+	if (len < 20)
+	    return PCAP_BAD;
+	ifid = PCAPNG_EPB == type ? get32(s, body) : get16(s, body);
+	caplen = get32(s, body + 12);
+	if (caplen > len - 20)
+	    return PCAP_BAD;
+	if (ifid >= s->nifs)
+	    return PCAP_SKIP;
+	if (PCAP_SKIP == decode_frame(s->ifs[ifid].linktype, (const unsigned char *)body + 20, caplen, src, dst))
+	    return PCAP_SKIP;
+	*t = ((uint64_t)get32(s, body + 4) << 32 | get32(s, body + 8)) / s->ifs[ifid].tsscale;
+	return PCAP_PACKET;
+    case PCAPNG_SPB:
+	if (len < 4 || 0 == s->nifs)
+	    return PCAP_SKIP;
+	caplen = get32(s, body);
+	if (caplen > len - 4)
+	    caplen = len - 4;
+	return decode_frame(s->ifs[0].linktype, (const unsigned char *)body + 4, caplen, src, dst);
+    default:
+	return PCAP_SKIP;
+    }
+}
@@ -0,0 +1,27 @@
+#ifndef PCAP_H
+#define PCAP_H
+
+#define PCAP_MAX_IFS 16
+
+/*
+ * State for decoding a classic pcap or pcapng capture without libpcap
+ */
+typedef struct {
+    int ng;			/* pcapng rather than classic pcap */
+    int swap;			/* file byte order is not ours */
+    unsigned int nifs;		/* pcapng interfaces in this section */
+    struct {
+	unsigned int linktype;
+	double tsscale;		/* timestamp units per second */
+    } ifs[PCAP_MAX_IFS];	/* classic pcap uses ifs[0] */
+} pcap_state;
+
+#define PCAP_SKIP 0		/* record consumed, but no IPv4 packet */
+#define PCAP_PACKET 1		/* record consumed, IPv4 packet decoded */
+#define PCAP_MORE -1		/* record is incomplete */
+#define PCAP_BAD -2		/* not a capture, or corrupt */
+
+int pcap_open(pcap_state *s, const char *p, const char *end, const char **next);
+int pcap_next(pcap_state *s, const char *p, const char *end, const char **next, double *t, unsigned int *src, unsigned int *dst);
+
+#endif
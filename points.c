@@ -0,0 +1,368 @@
+// glheatmap -- OpenGL-based interactive IPv4 heatmap
+//
+// Copyright (C) 2016 Verisign, Inc.
+//
+//  This file is part of glheatmap.
+//
+//  glheatmap is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  glheatmap is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with glheatmap  If not, see <http://www.gnu.org/licenses/>.
+//
+
+/*
+ * Point buffers.
+ *
+ * drawData() used to send every lit address down in immediate mode, with
+ * a glEnd()/glColor()/glBegin() at every change of color.  Instead, each
+ * /24 gets a block of points in a pair of vertex buffers: the positions,
+ * written when the block is laid out, and an intensity per point,
+ * rewritten by the caller when the page changes.  Intensity becomes color
+ * and alpha through a 1D texture, so the whole map is one draw call.
+ * Only GL 1.5 fixed-function features are used, so this runs on Mesa's
+ * llvmpipe as well as real hardware.
+ *
+ * A block holds a point for each cell in the page's cell map, in address
+ * order, and is only laid out again when that map changes.  Blocks come
+ * in power-of-two sizes from free lists, and are kept until the caller
+ * drops them, so a frame only has to rewrite the pages written since the
+ * last.  Intensities are decayed to a common epoch, and the texture
+ * matrix scales them by the decay since; every POINTS_REBASE of decay
+ * they are all rescaled and the epoch moved up.  Points with intensity
+ * zero are discarded by the alpha test.
+ */
+
+#define GL_GLEXT_PROTOTYPES
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <err.h>
+
+#if defined(__linux)
+#include <GL/gl.h>
+#include <GL/glext.h>
+#elif defined(__APPLE__)
+#include <OpenGL/gl.h>
+#endif
+
+#include "hue2rgb.h"
+#include "points.h"
+
+#define POINTS_CLASSES 9	/* blocks of 1 to 256 points */
+#define POINTS_REBASE (1.0 / 16)	/* decay at which the epoch moves */
+
+extern unsigned int xy_from_ip_block(unsigned ip, const uint64_t cells[4], unsigned *xp, unsigned *yp);
+extern double decay_factor(double dt);
+
+typedef struct {
+    uint64_t cells[4];		/* cells laid out, in address order */
+    uint32_t off;		/* first point in the buffers */
+    uint16_t n;			/* points laid out */
+    uint8_t class;		/* holds 1 << class points */
+    uint8_t used;
+} points_blk;
+
+typedef struct {
+    uint32_t *off;
+    unsigned int n;
+    unsigned int size;
+} points_free;
+
+static points_blk *BLOCKS[1 << 16];	/* by /16, then by third octet */
+static uint16_t NUSED[1 << 16];	/* blocks in use under each /16 */
+static bbox BOXES[1 << 16];	/* map units under each /16 with blocks */
+static unsigned int NBLOCKS = 0;
+static GLint *FIRST = 0;		/* blocks to draw, in address order */
+static GLsizei *COUNT = 0;
+static unsigned int DRAW_SIZE = 0;
+static points_free FREE[POINTS_CLASSES];
+static GLfloat *XY = 0;		/* copies of the buffers */
+static GLfloat *V = 0;
+static unsigned int NPOINTS = 0;	/* high water mark */
+static unsigned int CAPACITY = 0;	/* size of the GL buffers */
+static unsigned int XY_LO, XY_HI;	/* positions to upload */
+static unsigned int V_LO, V_HI;	/* intensities to upload */
+static double EPOCH = 0.0;	/* file time intensities are decayed to */
+static GLuint VBO_XY;
+static GLuint VBO_V;
+static GLuint TEX;
+
+/*
+ * Build the color map: intensity v, from 0 to POINTS_MAX_VALUE, has the
+ * hue drawData() always gave it, and an alpha that ramps up to
+ * 'fade_start' (or to 1 if that is 0).
+ */
+void
+points_init(unsigned int fade_start)
+{
+    static GLubyte map[POINTS_COLORS][4];
+    unsigned int k;
+    for (k = 0; k < POINTS_COLORS; k++) {
+	double v = POINTS_MAX_VALUE * k / (POINTS_COLORS - 1);
+	double hue = 240.0 * (256.0 - v) / 256.0;
+	double R = 0, G = 0, B = 0;
+	double A = fade_start ? v / fade_start : v;
+	HUE_TO_RGB(hue, R, G, B);
+	map[k][0] = 255.0 * R + 0.5;
+	map[k][1] = 255.0 * G + 0.5;
+	map[k][2] = 255.0 * B + 0.5;
+	map[k][3] = A < 1.0 ? 255.0 * A + 0.5 : 255;
+    }
+    glGenTextures(1, &TEX);
+    glBindTexture(GL_TEXTURE_1D, TEX);
+    glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexImage1D(GL_TEXTURE_1D, 0, GL_RGBA8, POINTS_COLORS, 0, GL_RGBA, GL_UNSIGNED_BYTE, map);
+    glBindTexture(GL_TEXTURE_1D, 0);
+    glGenBuffers(1, &VBO_XY);
+    glGenBuffers(1, &VBO_V);
+    XY_LO = V_LO = UINT32_MAX;
+    XY_HI = V_HI = 0;
+}
+
+static void
+points_grow(unsigned int need)
+{
+    unsigned int cap = CAPACITY ? CAPACITY : 1 << 16;
+    while (cap < need)
+	cap *= 2;
+    if (0 == (XY = realloc(XY, cap * 2 * sizeof(*XY))))
+	err(1, "realloc");
+    if (0 == (V = realloc(V, cap * sizeof(*V))))
+	err(1, "realloc");
+    CAPACITY = cap;
+    /* the buffers are reallocated in points_draw(), from these */
+    XY_LO = V_LO = 0;
+    XY_HI = V_HI = NPOINTS;
+}
+
+static uint32_t
+points_alloc(unsigned int class)
+{
+    points_free *f = FREE + class;
+    uint32_t off;
+    if (f->n)
+	return f->off[--f->n];
+    if (NPOINTS + (1u << class) > CAPACITY)
+	points_grow(NPOINTS + (1u << class));
+    off = NPOINTS;
+    NPOINTS += 1u << class;
+    return off;
+}
+
+static void
+points_release(points_blk *b)
+{
+    points_free *f = FREE + b->class;
+    unsigned int n = 1u << b->class;
+    if (f->n == f->size) {
+	f->size = f->size ? 2 * f->size : 1024;
+	if (0 == (f->off = realloc(f->off, f->size * sizeof(*f->off))))
+	    err(1, "realloc");
+    }
+    f->off[f->n++] = b->off;
+    memset(V + b->off, 0, n * sizeof(*V));
+    if (b->off < V_LO)
+	V_LO = b->off;
+    if (b->off + n > V_HI)
+	V_HI = b->off + n;
+    b->used = 0;
+    NBLOCKS--;
+}
+
+/*
+ * Forget the block for the /24 containing 'i', if it has one
+ */
+void
+points_drop(unsigned int i)
+{
+    points_blk *b;
+    if (0 == BLOCKS[i >> 16])
+	return;
+    b = &BLOCKS[i >> 16][(i >> 8) & 0xFF];
+    if (!b->used)
+	return;
+    points_release(b);
+    if (0 == --NUSED[i >> 16]) {
+	free(BLOCKS[i >> 16]);
+	BLOCKS[i >> 16] = 0;
+    }
+}
+
+/*
+ * Return the intensities of the block for the /24 containing 'i', one
+ * per bit set in 'cells' in order, for the caller to fill in decayed to
+ * the epoch from points_begin().  The block is (re)laid out if 'cells'
+ * is not what it was.  Returns 0, and drops the block, if 'cells' is
+ * empty.
+ */
+float *
+points_block(unsigned int i, const uint64_t cells[4])
+{
+    points_blk *b;
+    unsigned int n = __builtin_popcountll(cells[0]) + __builtin_popcountll(cells[1]) +
+	__builtin_popcountll(cells[2]) + __builtin_popcountll(cells[3]);
+    unsigned int class = 0;
+    unsigned int k;
+    if (0 == n) {
+	points_drop(i);
+	return 0;
+    }
+    while ((1u << class) < n)
+	class++;
+    if (0 == BLOCKS[i >> 16]) {
+	if (0 == (BLOCKS[i >> 16] = calloc(256, sizeof(points_blk))))
+	    err(1, "calloc");
+	BOXES[i >> 16] = bbox_from_int_slash(i & ~0xFFFFu, 16);
+    }
+    b = &BLOCKS[i >> 16][(i >> 8) & 0xFF];
+    if (b->used && (class > b->class || class + 1 < b->class)) {
+	points_release(b);
+	NUSED[i >> 16]--;
+    }
+    if (!b->used) {
+	if (++NBLOCKS > DRAW_SIZE) {
+	    DRAW_SIZE = DRAW_SIZE ? 2 * DRAW_SIZE : 4096;
+	    if (0 == (FIRST = realloc(FIRST, DRAW_SIZE * sizeof(*FIRST))))
+		err(1, "realloc");
+	    if (0 == (COUNT = realloc(COUNT, DRAW_SIZE * sizeof(*COUNT))))
+		err(1, "realloc");
+	}
+	NUSED[i >> 16]++;
+	b->class = class;
+	b->off = points_alloc(class);
+	b->used = 1;
+	memset(b->cells, 0, sizeof(b->cells));
+    }
+    if (memcmp(b->cells, cells, sizeof(b->cells))) {
+	GLfloat *xy = XY + 2 * b->off;
+	unsigned int x[256], y[256];
+	xy_from_ip_block(i, cells, x, y);
+	for (k = 0; k < n; k++) {
+	    xy[2 * k] = x[k];
+	    xy[2 * k + 1] = y[k];
+	}
+	memcpy(b->cells, cells, sizeof(b->cells));
+	b->n = n;
+	if (b->off < XY_LO)
+	    XY_LO = b->off;
+	if (b->off + (1u << b->class) > XY_HI)
+	    XY_HI = b->off + (1u << b->class);
+    }
+    if (b->off < V_LO)
+	V_LO = b->off;
+    if (b->off + (1u << b->class) > V_HI)
+	V_HI = b->off + (1u << b->class);
+    return V + b->off;
+}
+
+/*
+ * Start a frame at file time 'now'.  Returns the epoch that intensities
+ * written this frame are to be decayed to.
+ */
+double
+points_begin(double now)
+{
+    double f = decay_factor(now - EPOCH);
+    unsigned int k;
+    if (f > POINTS_REBASE)
+	return EPOCH;
+    for (k = 0; k < NPOINTS; k++)
+	V[k] *= f;
+    V_LO = 0;
+    V_HI = NPOINTS;
+    EPOCH = now;
+    return EPOCH;
+}
+
+/*
+ * Upload what changed, and draw the points of every /16 that overlaps
+ * 'window' (in map units) at the current point size, decayed to file
+ * time 'now'.  Returns the number of points drawn.
+ */
+unsigned int
+points_draw(bbox window, double now)
+{
+    static unsigned int allocated = 0;
+    unsigned int ndraw = 0;
+    unsigned int npoints = 0;
+    unsigned int k;
+    unsigned int c;
+    for (k = 0; k < (1 << 16); k++) {
+	const bbox *b = &BOXES[k];
+	if (0 == BLOCKS[k])
+	    continue;
+	if (b->xmax < window.xmin || b->xmin > window.xmax || b->ymax < window.ymin || b->ymin > window.ymax)
+	    continue;
+	for (c = 0; c < 256; c++) {
+	    if (!BLOCKS[k][c].used)
+		continue;
+	    FIRST[ndraw] = BLOCKS[k][c].off;
+	    COUNT[ndraw++] = BLOCKS[k][c].n;
+	    npoints += BLOCKS[k][c].n;
+	}
+    }
+
+    glBindBuffer(GL_ARRAY_BUFFER, VBO_XY);
+    if (allocated != CAPACITY) {
+	glBufferData(GL_ARRAY_BUFFER, CAPACITY * 2 * sizeof(*XY), XY, GL_STATIC_DRAW);
+    } else if (XY_LO < XY_HI) {
+	glBufferSubData(GL_ARRAY_BUFFER, XY_LO * 2 * sizeof(*XY), (XY_HI - XY_LO) * 2 * sizeof(*XY), XY + 2 * XY_LO);
+    }
+    glVertexPointer(2, GL_FLOAT, 0, 0);
+    glBindBuffer(GL_ARRAY_BUFFER, VBO_V);
+    if (allocated != CAPACITY) {
+	glBufferData(GL_ARRAY_BUFFER, CAPACITY * sizeof(*V), V, GL_DYNAMIC_DRAW);
+    } else if (V_LO < V_HI) {
+	glBufferSubData(GL_ARRAY_BUFFER, V_LO * sizeof(*V), (V_HI - V_LO) * sizeof(*V), V + V_LO);
+    }
+    glTexCoordPointer(1, GL_FLOAT, 0, 0);
+    allocated = CAPACITY;
+    XY_LO = V_LO = UINT32_MAX;
+    XY_HI = V_HI = 0;
+
+    /* intensity v lands on texel v / POINTS_MAX_VALUE * (COLORS - 1) */
+    glMatrixMode(GL_TEXTURE);
+    glLoadIdentity();
+    glTranslatef(0.5 / POINTS_COLORS, 0, 0);
+    glScalef(decay_factor(now - EPOCH) * (POINTS_COLORS - 1) / (POINTS_MAX_VALUE * POINTS_COLORS), 1, 1);
+    glMatrixMode(GL_PROJECTION);
+
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+    glEnable(GL_TEXTURE_1D);
+    glBindTexture(GL_TEXTURE_1D, TEX);
+    glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_REPLACE);
+    glEnable(GL_ALPHA_TEST);
+    glAlphaFunc(GL_GREATER, 0.0);
+    if (ndraw)
+	glMultiDrawArrays(GL_POINTS, FIRST, COUNT, ndraw);
+    glDisable(GL_ALPHA_TEST);
+    glDisable(GL_TEXTURE_1D);
+    glBindTexture(GL_TEXTURE_1D, 0);
+    glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+    glDisableClientState(GL_VERTEX_ARRAY);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glMatrixMode(GL_TEXTURE);
+    glLoadIdentity();
+    glMatrixMode(GL_PROJECTION);
+    return npoints;
+}
+
+/*
+ * The color map texture, for other renderers to share
+ */
+unsigned int
+points_colormap(void)
+{
+    return TEX;
+}
@@ -0,0 +1,23 @@
+#ifndef POINTS_H
+#define POINTS_H
+
+#include <stdint.h>
+#include "bbox.h"
+
+#define POINTS_COLORS 4096	/* texels in the color map */
+#define POINTS_MAX_VALUE 256.0	/* intensity at the end of the color map */
+
+/*
+ * Retained point geometry for the heatmap.  Each lit /24 owns a block of
+ * points in a vertex buffer, one per cell in its cell map, whose
+ * positions are uploaded when the block is laid out and whose intensities
+ * are rewritten as the counters change.
+ */
+void points_init(unsigned int fade_start);
+double points_begin(double now);
+float *points_block(unsigned int i, const uint64_t cells[4]);
+void points_drop(unsigned int i);
+unsigned int points_draw(bbox window, double now);
+unsigned int points_colormap(void);
+
+#endif
@@ -0,0 +1,210 @@
+// glheatmap -- OpenGL-based interactive IPv4 heatmap
+//
+// Copyright (C) 2016 Verisign, Inc.
+//
+//  This file is part of glheatmap.
+//
+//  glheatmap is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  glheatmap is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with glheatmap  If not, see <http://www.gnu.org/licenses/>.
+//
+
+
+/*
+ * Curve conversion benchmark.
+ *
+ * Converts a buffer of random indices to coordinates, and the
+ * coordinates back, at order 16 (a whole /0 at one address per pixel)
+ * and order 12, first with the two-bit loops the Hilbert functions used
+ * to be and then with the tables.  A /24 at a time through
+ * hil_xy_from_s_block() is timed as well.  The Morton conversions are
+ * timed with masks and, where the CPU has BMI2, with pext and pdep, next
+ * to the path mor_init() picked and the time it took to pick.  Reports
+ * conversions per second, the best of several passes, and fails if the
+ * tables and the loops disagree.
+ *
+ * Usage: bench_curve [conversions]
+ */
+
+#include "../hilbert.c"
+#include "../morton.c"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <err.h>
+
+#define PASSES 5
+
+static unsigned *S, *X, *Y, *T;
+static unsigned N;
+static unsigned sink;
+
+static double
+now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void
+xy_loop(int order)
+{
+    unsigned k;
+    for (k = 0; k < N; k++) {
+	unsigned state = 0;
+	hil_xy_from_s_bits(S[k], order, &state, X + k, Y + k);
+    }
+}
+
+static void
+xy_table(int order)
+{
+    unsigned k;
+    for (k = 0; k < N; k++)
+	hil_xy_from_s(S[k], order, X + k, Y + k);
+}
+
+static void
+xy_block(int order)
+{
+    static const uint64_t all[4] = {~0ull, ~0ull, ~0ull, ~0ull};
+    unsigned k;
+    for (k = 0; k + 256 <= N; k += 256)
+	hil_xy_from_s_block(S[k] & ~0xFFu, order, all, X + k, Y + k);
+}
+
+static void
+s_loop(int order)
+{
+    unsigned k;
+    for (k = 0; k < N; k++) {
+	unsigned state = 0;
+	hil_s_from_xy_bits(X[k], Y[k], order, &state, T + k);
+    }
+}
+
+static void
+s_table(int order)
+{
+    unsigned k;
+    for (k = 0; k < N; k++)
+	hil_s_from_xy(X[k], Y[k], order, T + k);
+}
+
+static void
+mor_xy(int order)
+{
+    unsigned k;
+    for (k = 0; k < N; k++)
+	mor_xy_from_s(S[k], order, X + k, Y + k);
+}
+
+static void
+mor_s(int order)
+{
+    unsigned k;
+    for (k = 0; k < N; k++)
+	mor_s_from_xy(X[k], Y[k], order, T + k);
+}
+
+static double
+run(const char *name, void (*fn)(int), int order)
+{
+    double best = 1e9;
+    unsigned k;
+    int pass;
+    for (pass = 0; pass < PASSES; pass++) {
+	double t = now();
+	fn(order);
+	t = now() - t;
+	if (t < best)
+	    best = t;
+    }
+    for (k = 0; k < N; k++)
+	sink += X[k] + Y[k] + T[k];
+    printf("order %2d %-14s %7.1fM conversions/s\n", order, name, N / best / 1e6);
+    return best;
+}
+
+static unsigned
+sum(const unsigned *a)
+{
+    unsigned r = 0;
+    unsigned k;
+    for (k = 0; k < N; k++)
+	r = r * 31 + a[k];
+    return r;
+}
+
+int
+main(int argc, char *argv[])
+{
+    static const int orders[] = {16, 12};
+    uint32_t seed = 1;
+    unsigned k;
+    int o;
+    int bad = 0;
+    N = argc > 1 ? strtoul(argv[1], 0, 0) : 1 << 22;
+    S = malloc(N * sizeof(*S));
+    X = calloc(N, sizeof(*X));
+    Y = calloc(N, sizeof(*Y));
+    T = calloc(N, sizeof(*T));
+    if (0 == S || 0 == X || 0 == Y || 0 == T)
+	err(1, "malloc");
+    hil_init();
+    for (o = 0; o < 2; o++) {
+	int order = orders[o];
+	unsigned xs, ys, ts;
+	for (k = 0; k < N; k++) {
+	    seed ^= seed << 13;
+	    seed ^= seed >> 17;
+	    seed ^= seed << 5;
+	    S[k] = order < 16 ? seed & ((1u << 2 * order) - 1) : seed;
+	}
+	run("xy loop", xy_loop, order);
+	xs = sum(X);
+	ys = sum(Y);
+	run("xy table", xy_table, order);
+	bad += xs != sum(X) || ys != sum(Y);
+	run("s loop", s_loop, order);
+	ts = sum(T);
+	run("s table", s_table, order);
+	bad += ts != sum(T) || ts != sum(S);
+	run("xy block /24", xy_block, order);
+    }
+    {
+	struct timeval t0, t1;
+	gettimeofday(&t0, 0);
+	mor_init();
+	gettimeofday(&t1, 0);
+	printf("mor_init() picked %s in %.2f ms\n", MOR_BMI2 ? "pext/pdep" : "masks",
+	    (t1.tv_sec - t0.tv_sec) * 1e3 + (t1.tv_usec - t0.tv_usec) * 1e-3);
+    }
+    for (k = 0; k < 2; k++) {
+	MOR_BMI2 = k;
+#ifdef MOR_X86
+	if (k && !__builtin_cpu_supports("bmi2"))
+	    break;
+#else
+	if (k)
+	    break;
+#endif
+	run(k ? "morton xy bmi2" : "morton xy mask", mor_xy, 16);
+	run(k ? "morton s bmi2" : "morton s mask", mor_s, 16);
+	bad += sum(T) != sum(S);
+    }
+    if (bad)
+	printf("results differ\n");
+    return bad ? 1 : 0;
+}
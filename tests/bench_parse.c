@@ -0,0 +1,184 @@
+// glheatmap -- OpenGL-based interactive IPv4 heatmap
+//
+// Copyright (C) 2016 Verisign, Inc.
+//
+//  This file is part of glheatmap.
+//
+//  glheatmap is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  glheatmap is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with glheatmap  If not, see <http://www.gnu.org/licenses/>.
+//
+
+/*
+ * Text input parsing benchmark.
+ *
+ * Generates a block of synthetic "time ip [value]" lines in memory, and
+ * parses it over and over until the requested number of lines (100M by
+ * default) have been parsed, first the way the stdin reader used to
+ * (fgets, strtok, strtod, inet_pton) and then with parse.c.  Most lines
+ * have fractional timestamps and dotted quads; some have integer times,
+ * integer addresses or a color value.  Reports lines per second for
+ * each, and fails if they disagree about what the lines say.
+ *
+ * Usage: bench_parse [lines]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <err.h>
+#include <arpa/inet.h>
+
+#include "parse.h"
+
+#define BLOCK_LINES (1 << 20)
+#define WHITESPACE " \t\r\n"
+
+typedef struct {
+    unsigned long lines;
+    unsigned long long ips;
+    unsigned long long values;
+    double times;
+} sums;
+
+static double
+now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static char *
+generate(size_t *len)
+{
+    char *buf = malloc(BLOCK_LINES * 48);
+    char *p = buf;
+    unsigned int seed = 1;
+    unsigned int k;
+    double t = 1448866220.0;
+    if (0 == buf)
+	err(1, "malloc");
+    for (k = 0; k < BLOCK_LINES; k++) {
+	unsigned int ip;
+	seed = seed * 1103515245 + 12345;
+	ip = seed ^ (seed >> 13) * 2654435761u;
+	t += (seed >> 20) * 1e-7;
+	if (k % 8 == 7)
+	    p += sprintf(p, "%.0f", t);
+	else
+	    p += sprintf(p, "%.6f", t);
+	if (k % 16 == 5)
+	    p += sprintf(p, "\t%u", ip);
+	else
+	    p += sprintf(p, "\t%u.%u.%u.%u", ip >> 24, (ip >> 16) & 0xFF, (ip >> 8) & 0xFF, ip & 0xFF);
+	if (k % 32 == 9)
+	    p += sprintf(p, " %u", seed >> 24);
+	*p++ = '\n';
+    }
+    *len = p - buf;
+    return buf;
+}
+
+/*
+ * As read_input_stdin() did before parse.c
+ */
+static void
+parse_libc(const char *block, size_t len, unsigned long max, sums *s)
+{
+    FILE *f = fmemopen((void *)block, len, "r");
+    char buf[512];
+    if (0 == f)
+	err(1, "fmemopen");
+    while (s->lines < max && fgets(buf, sizeof(buf), f)) {
+	unsigned int i = 0;
+	char *t;
+	char *e;
+	s->lines++;
+	if (NULL == (t = strtok(buf, WHITESPACE)))
+	    continue;
+	s->times += strtod(t, &e);
+	if (NULL == (t = strtok(NULL, WHITESPACE)))
+	    continue;
+	if (strspn(t, "0123456789") == strlen(t))
+	    i = strtoul(t, NULL, 10);
+	else if (1 == inet_pton(AF_INET, t, &i))
+	    i = ntohl(i);
+	s->ips += i;
+	if ((t = strtok(NULL, WHITESPACE)))
+	    s->values += strtoul(t, NULL, 10);
+    }
+    fclose(f);
+}
+
+/*
+ * As parse_line() does
+ */
+static void
+parse_inplace(const char *block, size_t len, unsigned long max, sums *s)
+{
+    const char *p = block;
+    const char *end = block + len;
+    while (s->lines < max && p < end) {
+	const char *eol = parse_eol(p, end);
+	const char *e;
+	unsigned int i;
+	double t;
+	s->lines++;
+	p = parse_skip_space(p, eol);
+	if (p < eol && (e = parse_time(p, eol, &t))) {
+	    s->times += t;
+	    p = parse_skip_space(e, eol);
+	    if (p < eol && (e = parse_ip(p, eol, &i))) {
+		s->ips += i;
+		p = parse_skip_space(e, eol);
+		if (p < eol)
+		    s->values += parse_ulong(p, eol);
+	    }
+	}
+	p = eol + 1;
+    }
+}
+
+static double
+run(const char *name, void (*fn)(const char *, size_t, unsigned long, sums *),
+    const char *block, size_t len, unsigned long n, sums *s)
+{
+    double t0 = now();
+    double el;
+    memset(s, 0, sizeof(*s));
+    while (s->lines < n)
+	fn(block, len, n, s);
+    el = now() - t0;
+    printf("%-8s %lu lines in %.2f s: %.2fM lines/s\n", name, s->lines, el, s->lines / el / 1e6);
+    return el;
+}
+
+int
+main(int argc, char *argv[])
+{
+    unsigned long n = argc > 1 ? strtoul(argv[1], 0, 0) : 100000000;
+    size_t len;
+    char *block = generate(&len);
+    sums a, b;
+    double ta, tb;
+    ta = run("libc", parse_libc, block, len, n, &a);
+    tb = run("parse.c", parse_inplace, block, len, n, &b);
+    printf("speedup %.2fx\n", ta / tb);
+    if (a.ips != b.ips || a.values != b.values || fabs(a.times - b.times) > 1e-12 * fabs(a.times)) {
+	printf("results differ\n");
+	return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,116 @@
+// glheatmap -- OpenGL-based interactive IPv4 heatmap
+//
+// Copyright (C) 2016 Verisign, Inc.
+//
+//  This file is part of glheatmap.
+//
+//  glheatmap is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  glheatmap is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with glheatmap  If not, see <http://www.gnu.org/licenses/>.
+//
+
+/*
+ * Page scaling benchmark.
+ *
+ * Scales a set of fully populated pages with the per-cell loop the decay
+ * used to run ("if (v) v *= decay") and with each kernel the CPU can run,
+ * and reports cells per second for each.  Every pass starts from the same
+ * cells; only the scaling is timed.
+ *
+ * Usage: bench_scale [pages]
+ */
+
+#include "../data.c"
+
+#include <stdio.h>
+#include <time.h>
+
+#define PASSES 20
+
+static double
+now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static int
+scale_old(DATA_TYPE *D, scale_t m)
+{
+#if DATA_CELL_BITS == 64
+    double decay = m;
+#else
+    double decay = m / 65536.0;
+#endif
+    int i;
+    for (i = 0; i < 256; i++) {
+	if (D[i]) {
+	    D[i] *= decay;
+	}
+    }
+    return 1;
+}
+
+static void
+run(const char *name, int (*fn)(DATA_TYPE *, scale_t), const DATA_TYPE *src, DATA_TYPE *D, size_t npages)
+{
+#if DATA_CELL_BITS == 64
+    scale_t m = 0.9;
+#else
+    scale_t m = 0xE666;
+#endif
+    double best = 1e9;
+    size_t p;
+    int pass;
+    for (pass = 0; pass < PASSES; pass++) {
+	double t;
+	memcpy(D, src, npages * 256 * sizeof(*D));
+	t = now();
+	for (p = 0; p < npages; p++)
+	    fn(D + p * 256, m);
+	t = now() - t;
+	if (t < best)
+	    best = t;
+    }
+    printf("%-8s %8.0fM cells/s\n", name, npages * 256 / best / 1e6);
+}
+
+int
+main(int argc, char *argv[])
+{
+    size_t npages = argc > 1 ? strtoul(argv[1], 0, 0) : 16384;
+    DATA_TYPE *src = malloc(npages * 256 * sizeof(*src));
+    DATA_TYPE *D = malloc(npages * 256 * sizeof(*D));
+    uint32_t x = 1;
+    size_t i;
+    if (0 == src || 0 == D)
+	err(1, "malloc");
+    for (i = 0; i < npages * 256; i++) {
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	src[i] = 1 + x % (uint32_t)DATA_CELL_MAX;
+    }
+    printf("%d-bit cells, %zu pages\n", DATA_CELL_BITS, npages);
+    run("old", scale_old, src, D, npages);
+    run("generic", scale_generic, src, D, npages);
+#if defined(__SSE2__)
+    run("sse2", scale_sse2, src, D, npages);
+#endif
+#if HAVE_AVX2_KERNEL
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+	run("avx2", scale_avx2, src, D, npages);
+#endif
+    return 0;
+}
@@ -0,0 +1,256 @@
+// glheatmap -- OpenGL-based interactive IPv4 heatmap
+//
+// Copyright (C) 2016 Verisign, Inc.
+//
+//  This file is part of glheatmap.
+//
+//  glheatmap is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  glheatmap is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with glheatmap  If not, see <http://www.gnu.org/licenses/>.
+//
+
+
+/*
+ * Check the table-driven Hilbert conversions against the two-bit loops
+ * they are built from, which are the original code.
+ *
+ * At every order up to 12 each index is converted both ways: the table
+ * must give the coordinates the loop gives, the coordinates must map
+ * back to the index, and consecutive indices must be neighbouring
+ * points.  Orders that are not a multiple of four are walked from state
+ * 1 when their padding is odd, so orders 1, 2, 3, 5 and so on pin that
+ * down.  hil_s_from_xy() is given a garbage *s each time, since it must
+ * set *s rather than shift into it.  At order 16 random indices are
+ * checked the same way, and hil_xy_from_s_block() against
+ * hil_xy_from_s() for random sets of cells.
+ *
+ * The Morton conversions are checked the same way, against a bit at a
+ * time, along each path the CPU can run (masks, and pext and pdep where
+ * there is BMI2), whichever mor_init() picked.
+ *
+ * Last, the map is cropped to a prefix within a /24, and converting that
+ * /24 a block at a time must give each address in the crop the same
+ * coordinates xy_from_ip() does, and every other address ~0u.
+ */
+
+#include "../hilbert.c"
+#include "../morton.c"
+#include "../xy_from_ip.c"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define TEST_MAX_EXHAUSTIVE 12
+#define TEST_RANDOM 4000000
+
+int DEBUG = 0;
+static uint32_t seed = 1;
+
+static uint32_t
+rnd(void)
+{
+    seed ^= seed << 13;
+    seed ^= seed >> 17;
+    seed ^= seed << 5;
+    return seed;
+}
+
+/*
+ * Check index 's' at 'order' and, if 'prev' is set, that it is next to
+ * the point at (px, py).  Returns the number of failures.
+ */
+static int
+check(unsigned s, int order, int prev, unsigned px, unsigned py, unsigned *xp, unsigned *yp)
+{
+    unsigned state = 0;
+    unsigned x, y, wx, wy, t;
+    int bad = 0;
+    hil_xy_from_s(s, order, &x, &y);
+    hil_xy_from_s_bits(s, order, &state, &wx, &wy);
+    if (x != wx || y != wy) {
+	if (bad++ < 4)
+	    fprintf(stderr, "order %d: s %u gave (%u, %u), the loop (%u, %u)\n", order, s, x, y, wx, wy);
+    }
+    t = 0xDEADBEEF;
+    hil_s_from_xy(x, y, order, &t);
+    if (t != s) {
+	if (bad++ < 4)
+	    fprintf(stderr, "order %d: (%u, %u) gave s %u, expected %u\n", order, x, y, t, s);
+    }
+    if (prev && (x - px) * (x - px) + (y - py) * (y - py) != 1) {
+	if (bad++ < 4)
+	    fprintf(stderr, "order %d: s %u at (%u, %u) is not next to (%u, %u)\n", order, s, x, y, px, py);
+    }
+    *xp = x;
+    *yp = y;
+    return bad;
+}
+
+static int
+check_block(unsigned s, int order)
+{
+    unsigned bx[256], by[256];
+    uint64_t cells[4];
+    unsigned n, k, i;
+    int bad = 0;
+    for (i = 0; i < 4; i++)
+	cells[i] = (uint64_t)rnd() << 32 | rnd();
+    if (rnd() % 4 == 0)
+	cells[rnd() % 4] = 0;
+    s &= ~0xFFu;
+    n = hil_xy_from_s_block(s, order, cells, bx, by);
+    for (i = 0, k = 0; i < 256; i++) {
+	unsigned x, y;
+	if (0 == (cells[i / 64] & (1ull << (i % 64))))
+	    continue;
+	hil_xy_from_s(s | i, order, &x, &y);
+	if (k >= n || bx[k] != x || by[k] != y) {
+	    if (bad++ < 4)
+		fprintf(stderr, "order %d: block %u cell %u wrong\n", order, s, i);
+	}
+	k++;
+    }
+    if (k != n)
+	bad++;
+    return bad;
+}
+
+/*
+ * Check Morton index 's' at 'order' along the path set in MOR_BMI2
+ */
+static int
+mor_check(unsigned s, int order)
+{
+    unsigned x, y, wx = 0, wy = 0, t;
+    int i;
+    for (i = order - 1; i >= 0; i--) {
+	wx = wx << 1 | ((s >> (2 * i + 1)) & 1);
+	wy = wy << 1 | ((s >> 2 * i) & 1);
+    }
+    mor_xy_from_s(s, order, &x, &y);
+    t = 0xDEADBEEF;
+    mor_s_from_xy(x, y, order, &t);
+    if (x == wx && y == wy && t == s)
+	return 0;
+    fprintf(stderr, "morton order %d: s %u gave (%u, %u) and back %u, expected (%u, %u)\n",
+	order, s, x, y, t, wx, wy);
+    return 1;
+}
+
+static int
+mor_check_block(unsigned s, int order)
+{
+    unsigned bx[256], by[256];
+    uint64_t cells[4];
+    unsigned n, k, i;
+    int bad = 0;
+    for (i = 0; i < 4; i++)
+	cells[i] = (uint64_t)rnd() << 32 | rnd();
+    s &= ~0xFFu;
+    n = mor_xy_from_s_block(s, order, cells, bx, by);
+    for (i = 0, k = 0; i < 256; i++) {
+	unsigned x, y;
+	if (0 == (cells[i / 64] & (1ull << (i % 64))))
+	    continue;
+	mor_xy_from_s(s | i, order, &x, &y);
+	bad += k >= n || bx[k] != x || by[k] != y;
+	k++;
+    }
+    return bad + (k != n);
+}
+
+int
+main(void)
+{
+    unsigned x = 0, y = 0;
+    unsigned s, k;
+    int order;
+    int bad;
+    int failures = 0;
+
+    hil_init();
+    for (order = 1; order <= TEST_MAX_EXHAUSTIVE; order++) {
+	bad = 0;
+	for (s = 0; s < 1u << 2 * order; s++)
+	    bad += check(s, order, s > 0, x, y, &x, &y);
+	if (order >= 4)
+	    for (k = 0; k < 1000; k++)
+		bad += check_block(rnd() & ((1u << 2 * order) - 1), order);
+	printf("test_curve hilbert order %d, all %u indices: %s\n", order, 1u << 2 * order, bad ? "FAILED" : "ok");
+	failures += bad;
+    }
+    for (order = 13; order <= 16; order++) {
+	unsigned mask = order < 16 ? (1u << 2 * order) - 1 : ~0u;
+	bad = 0;
+	for (k = 0; k < TEST_RANDOM; k++) {
+	    s = rnd() & (mask - 1);
+	    bad += check(s, order, 0, 0, 0, &x, &y);
+	    bad += check(s + 1, order, 1, x, y, &x, &y);
+	}
+	for (k = 0; k < 100000; k++)
+	    bad += check_block(rnd() & mask, order);
+	printf("test_curve hilbert order %d, %u random indices: %s\n", order, TEST_RANDOM, bad ? "FAILED" : "ok");
+	failures += bad;
+    }
+
+    mor_init();
+    printf("test_curve morton: mor_init() picked %s\n", MOR_BMI2 ? "pext/pdep" : "masks");
+    for (k = 0; k < 2; k++) {
+	MOR_BMI2 = k;
+#ifdef MOR_X86
+	if (k && !__builtin_cpu_supports("bmi2"))
+	    break;
+#else
+	if (k)
+	    break;
+#endif
+	bad = 0;
+	for (order = 1; order <= 16; order++) {
+	    unsigned mask = order < 16 ? (1u << 2 * order) - 1 : ~0u;
+	    if (order <= TEST_MAX_EXHAUSTIVE) {
+		for (s = 0; s <= mask; s++)
+		    bad += mor_check(s, order);
+	    } else {
+		for (s = 0; s < TEST_RANDOM; s++)
+		    bad += mor_check(rnd() & mask, order);
+	    }
+	    if (order >= 4)
+		for (s = 0; s < 1000; s++)
+		    bad += mor_check_block(rnd() & mask, order);
+	}
+	printf("test_curve morton %s, orders 1-16: %s\n", k ? "pext/pdep" : "masks", bad ? "FAILED" : "ok");
+	failures += bad;
+    }
+
+    bad = 0;
+    set_bits_per_pixel(0);
+    set_crop("10.1.2.128/26");
+    set_order();
+    {
+	static const uint64_t all[4] = {~0ull, ~0ull, ~0ull, ~0ull};
+	unsigned bx[256], by[256];
+	unsigned n = xy_from_ip_block(0x0A010200, all, bx, by);
+	bad += n != 256;
+	for (k = 0; k < n; k++) {
+	    unsigned ip = 0x0A010200 | k;
+	    if (ip >= 0x0A010280 && ip <= 0x0A0102BF) {
+		xy_from_ip(ip, &x, &y);
+		bad += bx[k] != x || by[k] != y;
+	    } else {
+		bad += bx[k] != ~0u || by[k] != ~0u;
+	    }
+	}
+    }
+    printf("test_curve crop to part of a /24: %s\n", bad ? "FAILED" : "ok");
+    failures += bad;
+    return failures ? 1 : 0;
+}
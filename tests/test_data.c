@@ -0,0 +1,220 @@
+// glheatmap -- OpenGL-based interactive IPv4 heatmap
+//
+// Copyright (C) 2016 Verisign, Inc.
+//
+//  This file is part of glheatmap.
+//
+//  glheatmap is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  glheatmap is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with glheatmap  If not, see <http://www.gnu.org/licenses/>.
+//
+
+/*
+ * Stress test for the counter storage.
+ *
+ * Several threads start together on an empty map and each increments
+ * every cell of the same set of /24s, ROUNDS times over, in its own
+ * order.  Before that, all of them look up a cell of every one of those
+ * /24s and of TOUCH_PAGES more, in the same order, so that they race to
+ * create every table and page at once; the extra /24s are never written.
+ * Increments are made as the ingest path makes them, under the page lock,
+ * so afterwards every cell must hold exactly threads * ROUNDS, the trie
+ * must have exactly the /8s, /16s and /24s looked up, each page must
+ * have been counted once, and every /24 written must be marked as
+ * changed.
+ *
+ * Usage: test_data trie|flat [threads]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <err.h>
+#include <pthread.h>
+#include <sched.h>
+
+#include "data.h"
+
+#define NPAGES 256		/* /24s written */
+#define ROUNDS 25		/* times each thread writes each cell */
+#define TOUCH_PAGES 16384	/* /24s only looked up, 250.0.0.0/10 */
+#define TOUCH_BASE 0xFA000000u
+#define MAX_THREADS 32
+
+static int START;
+static unsigned int NTHREADS = 8;
+
+/*
+ * The /24 written as page 'p': eight /8s, four /16s in each and eight
+ * /24s in each of those, scattered so that they share no table slots by
+ * accident of numbering
+ */
+static unsigned int
+page_ip(unsigned int p)
+{
+    unsigned int a = (p % 8) * 29 + 3;
+    unsigned int b = (p / 8 % 4) * 61 + 7;
+    unsigned int c = (p / 32) * 17 + 1;
+    return (a << 24) | (b << 16) | (c << 8);
+}
+
+static void *
+writer(void *arg)
+{
+    unsigned int id = (unsigned int)(uintptr_t)arg;
+    unsigned int n = NPAGES * 256;
+    unsigned int stride = 2 * id + 40503;	/* odd, so every cell once a round */
+    unsigned int r;
+    unsigned int k;
+    data_meta *m;
+    while (!__atomic_load_n(&START, __ATOMIC_ACQUIRE))
+	sched_yield();
+    for (k = 0; k < NPAGES; k++)
+	data_ptr(page_ip(k) | id, &m);
+    for (k = 0; k < TOUCH_PAGES; k++)
+	data_ptr(TOUCH_BASE | k << 8 | id, &m);
+    for (r = 0; r < ROUNDS; r++) {
+	for (k = 0; k < n; k++) {
+	    unsigned int x = (k * stride + id * 7919 + r) % n;
+	    unsigned int ip = page_ip(x >> 8) | (x & 0xFF);
+	    DATA_TYPE *D = data_ptr(ip, &m);
+	    data_lock(m);
+	    *D += 1;
+	    data_mark(m, ip & 0xFF);
+	    m->live = 1;
+	    data_dirty(ip);
+	    data_unlock(m);
+	}
+    }
+    return 0;
+}
+
+/*
+ * Whether i/prefixlen should have anything under it, counting the /24s
+ * only looked up if 'touched' is set
+ */
+static int
+expected(unsigned int i, int prefixlen, int touched)
+{
+    unsigned int mask = prefixlen ? ~0u << (32 - prefixlen) : 0;
+    unsigned int p;
+    if (touched && prefixlen && (i & 0xFFC00000u) == TOUCH_BASE)
+	return 1;
+    for (p = 0; p < NPAGES; p++)
+	if ((page_ip(p) & mask) == (i & mask))
+	    return 1;
+    return 0;
+}
+
+/*
+ * Check that the children of i/prefixlen in 'map' are exactly the
+ * expected ones.  Returns the number of failures.
+ */
+static int
+check_map(const char *what, unsigned int i, int prefixlen, const uint64_t map[4], int touched)
+{
+    int shift = 24 - prefixlen;
+    int bad = 0;
+    unsigned int k;
+    for (k = 0; k < 256; k++) {
+	int set = 0 != (map[k >> 6] & (1ull << (k & 63)));
+	unsigned int child = i | (k << shift);
+	if (set != expected(child, prefixlen + 8, touched)) {
+	    fprintf(stderr, "%s: %u.%u.%u.0/%d %s\n", what, child >> 24, (child >> 16) & 0xFF,
+		(child >> 8) & 0xFF, prefixlen + 8, set ? "present but never written" : "missing");
+	    bad++;
+	}
+    }
+    return bad;
+}
+
+int
+main(int argc, char *argv[])
+{
+    pthread_t threads[MAX_THREADS];
+    uint64_t slash8[4], slash16[4], slash24[4];
+    unsigned long pages;
+    size_t bytes;
+    unsigned int a, b, k;
+    int bad = 0;
+    if (argc < 2 || (strcmp(argv[1], "trie") && strcmp(argv[1], "flat")))
+	errx(2, "usage: test_data trie|flat [threads]");
+    if (argc > 2)
+	NTHREADS = strtoul(argv[2], 0, 0);
+    if (NTHREADS < 1 || NTHREADS > MAX_THREADS || NTHREADS * ROUNDS > DATA_CELL_MAX)
+	errx(2, "threads must be between 1 and %d", MAX_THREADS);
+    data_init(strcmp(argv[1], "flat") ? DATA_TRIE : DATA_FLAT);
+    for (k = 0; k < NTHREADS; k++)
+	pthread_create(threads + k, 0, writer, (void *)(uintptr_t)k);
+    __atomic_store_n(&START, 1, __ATOMIC_RELEASE);
+    for (k = 0; k < NTHREADS; k++)
+	pthread_join(threads[k], 0);
+
+    /* shape */
+    data_children(0, 0, slash8);
+    bad += check_map("children", 0, 0, slash8, 1);
+    DATA_FOREACH(slash8, a) {
+	data_children(a << 24, 8, slash16);
+	bad += check_map("children", a << 24, 8, slash16, 1);
+	DATA_FOREACH(slash16, b) {
+	    data_children((a << 24) | (b << 16), 16, slash24);
+	    bad += check_map("children", (a << 24) | (b << 16), 16, slash24, 1);
+	}
+    }
+
+    /* counts */
+    for (k = 0; k < NPAGES; k++) {
+	data_meta *m;
+	DATA_TYPE *D = data_page(page_ip(k), &m);
+	unsigned int d;
+	if (0 == D) {
+	    fprintf(stderr, "page %08x missing\n", page_ip(k));
+	    bad++;
+	    continue;
+	}
+	for (d = 0; d < 256; d++) {
+	    if (D[d] != NTHREADS * ROUNDS) {
+		fprintf(stderr, "cell %08x holds %g, expected %u\n", page_ip(k) | d, (double)D[d], NTHREADS * ROUNDS);
+		bad++;
+	    }
+	}
+	if (!m->live || ~(m->map[0] & m->map[1] & m->map[2] & m->map[3])) {
+	    fprintf(stderr, "page %08x not marked live in every cell\n", page_ip(k));
+	    bad++;
+	}
+    }
+    data_stats(&pages, &bytes);
+    if (pages != NPAGES + TOUCH_PAGES) {
+	fprintf(stderr, "%lu pages counted, expected %d\n", pages, NPAGES + TOUCH_PAGES);
+	bad++;
+    }
+
+    /* change marks, taken top down as the renderer does */
+    data_changed(0, 0, slash8);
+    bad += check_map("changed", 0, 0, slash8, 0);
+    DATA_FOREACH(slash8, a) {
+	data_changed(a << 24, 8, slash16);
+	bad += check_map("changed", a << 24, 8, slash16, 0);
+	DATA_FOREACH(slash16, b) {
+	    data_changed((a << 24) | (b << 16), 16, slash24);
+	    bad += check_map("changed", (a << 24) | (b << 16), 16, slash24, 0);
+	}
+    }
+    if (data_changed(0, 0, slash8)) {
+	fprintf(stderr, "change marks not cleared once taken\n");
+	bad++;
+    }
+
+    printf("test_data %s: %u threads, %u increments: %s\n", argv[1], NTHREADS,
+	NTHREADS * ROUNDS * NPAGES * 256, bad ? "FAILED" : "ok");
+    return bad ? 1 : 0;
+}
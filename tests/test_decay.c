@@ -0,0 +1,149 @@
+// glheatmap -- OpenGL-based interactive IPv4 heatmap
+//
+// Copyright (C) 2016 Verisign, Inc.
+//
+//  This file is part of glheatmap.
+//
+//  glheatmap is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  glheatmap is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with glheatmap  If not, see <http://www.gnu.org/licenses/>.
+//
+
+/*
+ * Test of the decay sweep shared between the worker and its helpers.
+ *
+ * A map of /24s spread over many /8s is halved by one sweep ('h'), which
+ * must halve every cell and keep every page.  Then, with
+ * writer threads adding to other /24s all the while, file time is moved
+ * on far enough for everything else to fade: repeated sweeps must retire
+ * every faded page, from whichever thread swept it, and leave the page
+ * count matching what is still in the trie.
+ *
+ * Usage: test_decay trie|flat [threads]
+ */
+
+#define main glheatmap_main
+#include "../glheatmap.c"
+#undef main
+
+#define TEST_PAGES 20000
+#define TEST_WRITERS 2
+
+static int failures = 0;
+static int writing = 1;
+
+static unsigned int
+test_page(unsigned int p)
+{
+    return ((p % 97 + 20) << 24) | ((p / 97 * 13) & 0xFFFF) << 8;
+}
+
+static unsigned int
+test_count(unsigned int p, unsigned int k)
+{
+    return (p + k) % 7 ? 0 : p % 5 + 2;
+}
+
+static void *
+writer(void *arg)
+{
+    unsigned int id = (uintptr_t)arg;
+    unsigned int n = 0;
+    while (__atomic_load_n(&writing, __ATOMIC_RELAXED))
+	data_inc(0xC0A80000 | id << 12 | (n++ & 0xFFF));
+    data_offline();
+    return 0;
+}
+
+/*
+ * Count the pages in the map by walking it
+ */
+static unsigned long
+walk(void)
+{
+    uint64_t slash8[4], slash16[4], slash24[4];
+    unsigned long n = 0;
+    unsigned int a, b, c;
+    data_children(0, 0, slash8);
+    DATA_FOREACH(slash8, a) {
+	data_children(a << 24, 8, slash16);
+	DATA_FOREACH(slash16, b) {
+	    data_children(a << 24 | b << 16, 16, slash24);
+	    DATA_FOREACH(slash24, c)
+		n += 0 != data_page(a << 24 | b << 16 | c << 8, 0);
+	}
+    }
+    return n;
+}
+
+int
+main(int argc, char *argv[])
+{
+    pthread_t helper;
+    pthread_t writers[TEST_WRITERS];
+    unsigned long pages;
+    size_t bytes;
+    unsigned int p, k, n;
+    int bad;
+
+    if (argc < 2 || (strcmp(argv[1], "trie") && strcmp(argv[1], "flat")))
+	errx(2, "usage: test_decay trie|flat [threads]");
+    OPT_THREADS = argc > 2 ? strtoul(argv[2], 0, 0) : 4;
+    data_init(strcmp(argv[1], "flat") ? DATA_TRIE : DATA_FLAT);
+    for (k = 1; k < OPT_THREADS; k++)
+	pthread_create(&helper, 0, decay_helper, 0);
+    FILE_TIME = 1000.0;
+
+    for (p = 0; p < TEST_PAGES; p++)
+	for (k = 0; k < 256; k++)
+	    for (n = test_count(p, k); n; n--)
+		data_inc(test_page(p) | k);
+
+    /* halve */
+    decay_sweep(FILE_TIME, 0.5);
+    bad = 0;
+    for (p = 0; p < TEST_PAGES; p++) {
+	DATA_TYPE *D = data_page(test_page(p), 0);
+	for (k = 0; D && k < 256; k++) {
+	    double want = test_count(p, k) * DATA_ONE * 0.5;
+	    if (D[k] < floor(want) || D[k] > ceil(want))
+		bad++;
+	}
+	if (!D)
+	    bad++;
+    }
+    printf("halve, %u threads: %d bad pages or cells%s\n", OPT_THREADS, bad, bad ? "  FAILED" : "");
+    failures += bad;
+
+    /* fade, with writers */
+    for (k = 0; k < TEST_WRITERS; k++)
+	pthread_create(writers + k, 0, writer, (void *)(uintptr_t)k);
+    FILE_TIME += 100 * HALF_LIFE;
+    for (k = 0; k < 5; k++) {
+	decay_sweep(FILE_TIME, 1.0);
+	data_reclaim();
+	usleep(1000);
+    }
+    __atomic_store_n(&writing, 0, __ATOMIC_RELAXED);
+    for (k = 0; k < TEST_WRITERS; k++)
+	pthread_join(writers[k], 0);
+    bad = 0;
+    for (p = 0; p < TEST_PAGES; p++)
+	bad += 0 != data_page(test_page(p), 0);
+    data_stats(&pages, &bytes);
+    printf("fade, %u threads: %d faded pages left, %lu pages counted, %lu in the map%s\n",
+	OPT_THREADS, bad, pages, walk(), bad || pages != walk() ? "  FAILED" : "");
+    failures += bad + (pages != walk());
+
+    printf("test_decay %s: %s\n", argv[1], failures ? "FAILED" : "ok");
+    return failures ? 1 : 0;
+}
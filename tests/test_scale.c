@@ -0,0 +1,192 @@
+// glheatmap -- OpenGL-based interactive IPv4 heatmap
+//
+// Copyright (C) 2016 Verisign, Inc.
+//
+//  This file is part of glheatmap.
+//
+//  glheatmap is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  glheatmap is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with glheatmap  If not, see <http://www.gnu.org/licenses/>.
+//
+
+/*
+ * Check each page scaling kernel the CPU can run against the portable
+ * one.
+ *
+ * The dither streams differ between kernels, so rather than comparing
+ * cells one for one, every kernel must keep to the same rules: a zero
+ * cell stays zero, an integer cell v scaled by m becomes floor(v*m/2^16)
+ * or one more, and only one more if v*m/2^16 was not whole.  The return
+ * value must say whether any cell is left.  Over many pages each kernel's
+ * mean must be v*m/2^16, and double cells must be exactly v*m.
+ */
+
+#include "../data.c"
+
+#include <stdio.h>
+#include <math.h>
+
+typedef struct {
+    const char *name;
+    int (*fn)(DATA_TYPE *, scale_t);
+} kernel;
+
+static kernel KERNELS[4];
+static int NKERNELS = 0;
+static uint32_t seed = 1;
+
+static uint32_t
+rnd(void)
+{
+    seed ^= seed << 13;
+    seed ^= seed >> 17;
+    seed ^= seed << 5;
+    return seed;
+}
+
+/*
+ * A page of random cells, mostly below 'max', some zero and some at the
+ * cell maximum
+ */
+static void
+fill(DATA_TYPE *D, double max)
+{
+    int i;
+    for (i = 0; i < 256; i++) {
+	uint32_t r = rnd();
+	if (r % 5 == 0)
+	    D[i] = 0;
+	else if (r % 17 == 0)
+	    D[i] = DATA_CELL_MAX;
+	else
+	    D[i] = (DATA_TYPE)(max * (rnd() & 0xFFFF) / 65536.0);
+    }
+}
+
+/*
+ * Scale one page with kernel 'k' and check each cell.  Returns the number
+ * of failures.
+ */
+static int
+check_page(const kernel *k, const DATA_TYPE *in, scale_t m)
+{
+    DATA_TYPE D[256];
+    int any = 0;
+    int bad = 0;
+    int r;
+    int i;
+    memcpy(D, in, sizeof(D));
+    r = k->fn(D, m);
+    for (i = 0; i < 256; i++) {
+#if DATA_CELL_BITS == 64
+	int ok = D[i] == in[i] * m;
+#else
+	uint64_t exact = (uint64_t)in[i] * m;
+	uint64_t lo = exact >> 16;
+	int ok = D[i] == lo || (D[i] == lo + 1 && (exact & 0xFFFF));
+#endif
+	if (!ok && bad++ < 4)
+	    fprintf(stderr, "%s: cell %g scaled by %g gave %g\n", k->name,
+		(double)in[i], (double)m, (double)D[i]);
+	any = any || D[i];
+    }
+    if ((0 != r) != any) {
+	fprintf(stderr, "%s: returned %d but %s cells left\n", k->name, r, any ? "some" : "no");
+	bad++;
+    }
+    return bad;
+}
+
+#if DATA_CELL_BITS != 64
+/*
+ * Scale 'n' copies of a page of cells all 'v' by 'm' with kernel 'k' and
+ * return the mean result
+ */
+static double
+mean(const kernel *k, DATA_TYPE v, scale_t m, int n)
+{
+    DATA_TYPE D[256];
+    double sum = 0;
+    int i;
+    int j;
+    for (j = 0; j < n; j++) {
+	for (i = 0; i < 256; i++)
+	    D[i] = v;
+	k->fn(D, m);
+	for (i = 0; i < 256; i++)
+	    sum += D[i];
+    }
+    return sum / (256.0 * n);
+}
+#endif
+
+int
+main(void)
+{
+#if DATA_CELL_BITS == 64
+    static const scale_t factors[] = {0.0, 1e-9, 0.25, 0.5, 0.7071, 0.999, 1.0};
+#else
+    static const scale_t factors[] = {0, 1, 2, 255, 256, 0x7FFF, 0x8000, 0xB505, 0xFFFE, 0xFFFF};
+#endif
+    DATA_TYPE page[256];
+    int bad = 0;
+    int k;
+    int t;
+    unsigned int f;
+
+    KERNELS[NKERNELS++] = (kernel) {"generic", scale_generic};
+#if defined(__SSE2__)
+    KERNELS[NKERNELS++] = (kernel) {"sse2", scale_sse2};
+#endif
+#if HAVE_AVX2_KERNEL
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+	KERNELS[NKERNELS++] = (kernel) {"avx2", scale_avx2};
+#endif
+
+    for (k = 0; k < NKERNELS; k++) {
+	int kbad = 0;
+	/* random pages at fixed and random factors */
+	for (t = 0; t < 2000; t++) {
+	    fill(page, t % 2 ? DATA_CELL_MAX : 8 * DATA_ONE);
+	    for (f = 0; f < sizeof(factors) / sizeof(factors[0]); f++)
+		kbad += check_page(&KERNELS[k], page, factors[f]);
+#if DATA_CELL_BITS == 64
+	    kbad += check_page(&KERNELS[k], page, (rnd() & 0xFFFF) / 65536.0);
+#else
+	    kbad += check_page(&KERNELS[k], page, rnd() & 0xFFFF);
+#endif
+	}
+	/* a page that is all zero, or that scales to all zero */
+	memset(page, 0, sizeof(page));
+	kbad += check_page(&KERNELS[k], page, factors[2]);
+	page[77] = 1;
+	kbad += check_page(&KERNELS[k], page, 0);
+#if DATA_CELL_BITS != 64
+	/* rounding is unbiased */
+	for (t = 0; t < 4; t++) {
+	    static const DATA_TYPE values[] = {1, 3, 100, DATA_CELL_MAX};
+	    static const scale_t ms[] = {0x8000, 0x1234, 0xB505, 0xFFFF};
+	    double want = values[t] * (double)ms[t] / 65536.0;
+	    double got = mean(&KERNELS[k], values[t], ms[t], 2000);
+	    if (fabs(got - want) > 0.01) {
+		fprintf(stderr, "%s: %g scaled by %g averaged %.4f, expected %.4f\n",
+		    KERNELS[k].name, (double)values[t], (double)ms[t], got, want);
+		kbad++;
+	    }
+	}
+#endif
+	printf("test_scale %d-bit %s: %s\n", DATA_CELL_BITS, KERNELS[k].name, kbad ? "FAILED" : "ok");
+	bad += kbad;
+    }
+    return bad ? 1 : 0;
+}
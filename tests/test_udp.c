@@ -0,0 +1,189 @@
+// glheatmap -- OpenGL-based interactive IPv4 heatmap
+//
+// Copyright (C) 2016 Verisign, Inc.
+//
+//  This file is part of glheatmap.
+//
+//  glheatmap is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  glheatmap is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with glheatmap  If not, see <http://www.gnu.org/licenses/>.
+//
+
+/*
+ * Loopback test of datagram input (-U).
+ *
+ * The real reader (read_input_stream) runs on its own thread with one -U
+ * socket bound to a loopback port, and this program sends to it.
+ *
+ * First two senders each send a paced run of datagrams with a few
+ * sequence numbers skipped: every record sent must be applied, exactly
+ * the skipped datagrams counted as lost, and both peers seen.
+ *
+ * Then one sender blasts datagrams as fast as it can for a couple of
+ * seconds, never waiting for the reader, and one more after a pause so
+ * that a loss at the very end shows as a gap.  The send rate, ingest rate
+ * and losses are reported, and every datagram sent must have been either
+ * applied or counted as lost.
+ *
+ * Usage: test_udp [seconds]
+ */
+
+#define main glheatmap_main
+#include "../glheatmap.c"
+#undef main
+
+#define TEST_RECS 100		/* records per datagram */
+#define TEST_PACED 2000		/* datagrams per paced sender */
+
+static int failures = 0;
+
+static double
+now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static unsigned int
+received(void)
+{
+    return __atomic_load_n(&SOURCES[0].nquery, __ATOMIC_RELAXED) / TEST_RECS;
+}
+
+static unsigned int
+lost(void)
+{
+    return __atomic_load_n(&SOURCES[0].lost, __ATOMIC_RELAXED);
+}
+
+/*
+ * Wait up to a second for the reader to have received 'n' datagrams
+ */
+static void
+settle(unsigned int n)
+{
+    double t = now() + 1.0;
+    while (received() < n && now() < t)
+	usleep(1000);
+}
+
+/*
+ * Send datagram 'seq' carrying TEST_RECS records for addresses in
+ * 10.seq.0.0/16.  Returns 0 if the send failed.
+ */
+static int
+send_dgram(int s, const struct sockaddr_in *to, uint32_t seq)
+{
+    char buf[4 + TEST_RECS * STREAM_RECSIZE];
+    char *p = buf + 4;
+    uint32_t v = htonl(seq);
+    unsigned int k;
+    memcpy(buf, &v, 4);
+    for (k = 0; k < TEST_RECS; k++, p += STREAM_RECSIZE) {
+	uint32_t t = htonl(1448866220);
+	uint32_t u = 0;
+	uint32_t ip = 0x0A000000 | (seq & 0xFF) << 16 | k;
+	memcpy(p, &t, 4);
+	memcpy(p + 4, &u, 4);
+	memcpy(p + 8, &ip, 4);
+    }
+    return sendto(s, buf, sizeof(buf), 0, (const struct sockaddr *)to, sizeof(*to)) == sizeof(buf);
+}
+
+static void
+check(int ok, const char *what, unsigned int got, unsigned int want)
+{
+    printf("  %-24s %u (expected %u)%s\n", what, got, want, ok ? "" : "  FAILED");
+    if (!ok)
+	failures++;
+}
+
+static void *
+reader(void *arg)
+{
+    read_input_stream();
+    return 0;
+}
+
+int
+main(int argc, char *argv[])
+{
+    double secs = argc > 1 ? atof(argv[1]) : 2.0;
+    struct sockaddr_in to;
+    socklen_t tolen = sizeof(to);
+    pthread_t thread;
+    int s1 = socket(PF_INET, SOCK_DGRAM, 0);
+    int s2 = socket(PF_INET, SOCK_DGRAM, 0);
+    unsigned int skipped = 0;
+    unsigned int sent = 0;
+    unsigned int errors = 0;
+    unsigned int base;
+    unsigned int base_lost;
+    uint32_t seq;
+    double t0;
+    double el;
+
+    data_init(DATA_TRIE);
+    HALF_LIFE = 0;
+    open_udp(strdup("127.0.0.1:0"));
+    if (getsockname(SOURCES[0].fd, (struct sockaddr *)&to, &tolen) < 0)
+	err(1, "getsockname");
+    READING = 1;
+    pthread_create(&thread, 0, reader, 0);
+
+    printf("paced, two senders:\n");
+    for (seq = 0; seq < TEST_PACED; seq++) {
+	if (seq % 500 != 250)
+	    sent += send_dgram(s1, &to, seq);
+	else
+	    skipped++;
+	if (seq % 700 != 350)
+	    sent += send_dgram(s2, &to, seq);
+	else
+	    skipped++;
+	if (seq % 32 == 0)
+	    settle(sent);
+    }
+    settle(sent);
+    check(received() == sent, "datagrams applied", received(), sent);
+    check(lost() == skipped, "datagrams lost", lost(), skipped);
+    check(SOURCES[0].npeers == 2, "peers", SOURCES[0].npeers, 2);
+    check(NQUERY == sent * TEST_RECS, "NQUERY", NQUERY, sent * TEST_RECS);
+
+    printf("blast, %.1f s:\n", secs);
+    base = received();
+    base_lost = lost();
+    sent = 0;
+    t0 = now();
+    for (seq = 0; now() - t0 < secs; seq++) {
+	if (send_dgram(s1, &to, TEST_PACED + seq))
+	    sent++;
+	else
+	    errors++;
+    }
+    el = now() - t0;
+    usleep(100000);
+    send_dgram(s1, &to, TEST_PACED + seq);
+    sent++;
+    t0 = now();
+    while (received() - base + lost() - base_lost < sent + errors && now() - t0 < 1.0)
+	usleep(1000);
+    printf("  sent %u datagrams (%.0f/s, %.2fM records/s), %u send errors\n",
+	sent, sent / el, sent * TEST_RECS / el / 1e6, errors);
+    printf("  applied %u (%.2fM records/s), lost %u, kernel drops %u\n", received() - base,
+	(received() - base) * TEST_RECS / el / 1e6, lost() - base_lost, SOURCES[0].kdrops);
+    check(received() - base + lost() - base_lost == sent + errors, "applied + lost", received() - base + lost() - base_lost, sent + errors);
+
+    printf("test_udp: %s\n", failures ? "FAILED" : "ok");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,618 @@
+// glheatmap -- OpenGL-based interactive IPv4 heatmap
+//
+// Copyright (C) 2016 Verisign, Inc.
+//
+//  This file is part of glheatmap.
+//
+//  glheatmap is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  glheatmap is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with glheatmap  If not, see <http://www.gnu.org/licenses/>.
+//
+
+/*
+ * Texture tile pyramid.
+ *
+ * Drawing a point per lit address costs in proportion to the addresses,
+ * however little of the screen they cover.  Here the counters are
+ * rasterized into 256x256 float textures instead, at the level of the
+ * pyramid whose texels are no smaller than a screen pixel, and drawn as
+ * one textured quad per tile.  On either curve an aligned square of 2^k
+ * by 2^k texels is a contiguous block of addresses, so each tile is a
+ * prefix: a /16 at level 0, a /14 at level 1, and so on up to the whole
+ * map.  A texel above level 0 holds the hottest address under it, so
+ * that busy addresses stay visible however far out the view is zoomed.
+ *
+ * Texels are decayed to the tile's epoch, the file time it was built or
+ * last rebased, and a fragment shader applies the decay since then, the
+ * display floor and the color map.  Decay is the same for every address,
+ * so a tile stays right as time passes and only needs redrawing where
+ * counters are written: tiles_update() redraws a /24 that has changed in
+ * every cached tile over it, and only the texels touched are uploaded.
+ * Tiles are kept in a cache of TILE_MAX and evicted least recently drawn
+ * first, but never one drawn in the frame being built: if a window shows
+ * more tiles than that, the cache grows to hold them.  A new half-life
+ * invalidates them all, and they are rebuilt within TILE_BUDGET of each
+ * frame.
+ *
+ * Tiles need GL 2.0 for the shader and R32F textures for the texels;
+ * tiles_init() fails without them and the caller draws points instead.
+ */
+
+#define GL_GLEXT_PROTOTYPES
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <err.h>
+#include <sys/time.h>
+
+#if defined(__linux)
+#include <GL/gl.h>
+#include <GL/glext.h>
+#elif defined(__APPLE__)
+#include <OpenGL/gl.h>
+#include <OpenGL/glext.h>
+#endif
+
+#include "data.h"
+#include "points.h"
+#include "tiles.h"
+
+#define TILE_SIZE 256
+#define TILE_MAX 256		/* tiles cached, unless more are in view */
+#define TILE_BUDGET 0.02	/* seconds per frame spent rebuilding */
+#define TILE_REBASE (1.0 / 16)	/* decay at which a tile is rebased */
+#define TILE_SLOTS 87381	/* tiles in all levels: (4^9 - 1) / 3 */
+
+extern unsigned int ip_from_xy(unsigned x, unsigned y, unsigned *ip);
+extern unsigned int xy_from_ip(unsigned ip, unsigned *xp, unsigned *yp);
+extern unsigned int xy_from_ip_block(unsigned ip, const uint64_t cells[4], unsigned *xp, unsigned *yp);
+extern double decay_factor(double dt);
+
+typedef struct {
+    float *u;			/* texels, decayed to 'epoch' */
+    uint8_t *owner;		/* /24 each texel's value came from */
+    double epoch;
+    unsigned int slot;		/* index in TILES */
+    unsigned int ip;		/* first address */
+    unsigned int x0, y0;	/* top left, in map units */
+    unsigned int gen;		/* GEN when built */
+    unsigned int drawn;		/* frame last drawn */
+    unsigned int lo_x, lo_y, hi_x, hi_y;	/* texels to upload */
+    unsigned int block;		/* last redrawn whole by tiles_update() */
+    unsigned int block_frame;
+    int level;
+    int lit;			/* any texel at or above the floor */
+    GLuint tex;
+} tile;
+
+static tile *TILES[TILE_SLOTS];
+static unsigned int BASE[TILES_LEVELS];	/* first slot of each level */
+static tile **CACHE = 0;
+static unsigned int NCACHE = 0;
+static unsigned int CACHE_SIZE = 0;	/* entries allocated in CACHE */
+static unsigned int GEN = 1;
+static unsigned int FRAME = 1;
+static unsigned int NDRAWN = 0;
+static int LEVEL = 0;
+static double FLOOR = 0.0;
+static GLuint PROGRAM;
+static GLint U_DECAY;
+
+static const char *FRAGMENT_SHADER =
+"uniform sampler2D tile;\n"
+"uniform sampler1D colors;\n"
+"uniform float decay;\n"
+"uniform float cutoff;\n"
+"uniform float colorscale;\n"
+"uniform float coloroffset;\n"
+"void main() {\n"
+"    float v = texture2D(tile, gl_TexCoord[0].st).r * decay;\n"
+"    if (v < cutoff)\n"
+"        discard;\n"
+"    gl_FragColor = texture1D(colors, v * colorscale + coloroffset);\n"
+"}\n";
+
+static double
+wall_time(void)
+{
+    struct timeval tv;
+    gettimeofday(&tv, 0);
+    return tv.tv_sec + 0.000001 * tv.tv_usec;
+}
+
+/*
+ * Compile the shader and check that float textures work.  Returns 0 if
+ * this GL cannot draw tiles.  Call after points_init(), whose color map
+ * is shared.
+ */
+int
+tiles_init(double floor)
+{
+    const char *version = (const char *)glGetString(GL_VERSION);
+    GLuint sh;
+    GLuint tex;
+    GLint ok;
+    int L;
+    for (L = 1; L < TILES_LEVELS; L++)
+	BASE[L] = BASE[L - 1] + (TILE_SIZE >> (L - 1)) * (TILE_SIZE >> (L - 1));
+    if (0 == version || atof(version) < 2.0)
+	return 0;
+    sh = glCreateShader(GL_FRAGMENT_SHADER);
+    glShaderSource(sh, 1, &FRAGMENT_SHADER, 0);
+    glCompileShader(sh);
+    glGetShaderiv(sh, GL_COMPILE_STATUS, &ok);
+    if (!ok)
+	return 0;
+    PROGRAM = glCreateProgram();
+    glAttachShader(PROGRAM, sh);
+    glLinkProgram(PROGRAM);
+    glGetProgramiv(PROGRAM, GL_LINK_STATUS, &ok);
+    if (!ok)
+	return 0;
+    while (glGetError() != GL_NO_ERROR)
+	;
+    glGenTextures(1, &tex);
+    glBindTexture(GL_TEXTURE_2D, tex);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, TILE_SIZE, TILE_SIZE, 0, GL_RED, GL_FLOAT, 0);
+    ok = glGetError() == GL_NO_ERROR;
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glDeleteTextures(1, &tex);
+    if (!ok)
+	return 0;
+    glUseProgram(PROGRAM);
+    glUniform1i(glGetUniformLocation(PROGRAM, "tile"), 0);
+    glUniform1i(glGetUniformLocation(PROGRAM, "colors"), 1);
+    glUniform1f(glGetUniformLocation(PROGRAM, "cutoff"), floor);
+    /* intensity v lands on texel v / POINTS_MAX_VALUE * (COLORS - 1) */
+    glUniform1f(glGetUniformLocation(PROGRAM, "colorscale"), (POINTS_COLORS - 1) / (POINTS_MAX_VALUE * POINTS_COLORS));
+    glUniform1f(glGetUniformLocation(PROGRAM, "coloroffset"), 0.5 / POINTS_COLORS);
+    U_DECAY = glGetUniformLocation(PROGRAM, "decay");
+    glUseProgram(0);
+    FLOOR = floor;
+    return 1;
+}
+
+/*
+ * Mark every tile for rebuilding, for when the epochs no longer account
+ * for the decay (a new half-life)
+ */
+void
+tiles_invalidate(void)
+{
+    GEN++;
+}
+
+void
+tiles_stats(unsigned int *ntiles, int *level)
+{
+    *ntiles = NDRAWN;
+    *level = LEVEL;
+}
+
+/*
+ * Set 'out' to the bits of 'map' from 'lo' to 'lo + n - 1'
+ */
+static void
+map_range(const uint64_t map[4], unsigned int lo, unsigned int n, uint64_t out[4])
+{
+    unsigned int w;
+    for (w = 0; w < 4; w++) {
+	unsigned int a = w * 64;
+	uint64_t m = 0;
+	if (lo < a + 64 && lo + n > a) {
+	    unsigned int s = lo > a ? lo - a : 0;
+	    unsigned int e = lo + n < a + 64 ? lo + n - a : 64;
+	    m = (e - s == 64 ? ~0ull : ((1ull << (e - s)) - 1)) << s;
+	}
+	out[w] = map[w] & m;
+    }
+}
+
+/*
+ * The /8s and /16s under tile 't', as ranges of second and first octets
+ */
+static void
+tile_span(const tile *t, unsigned int *a0, unsigned int *na, unsigned int *b0, unsigned int *nb)
+{
+    *a0 = t->ip >> 24;
+    *na = t->level > 4 ? 1u << (2 * (t->level - 4)) : 1;
+    *b0 = t->level < 4 ? (t->ip >> 16) & 0xFF : 0;
+    *nb = t->level < 4 ? 1u << (2 * t->level) : 256;
+}
+
+/*
+ * Whether anything is stored under tile 't'
+ */
+static int
+tile_occupied(const tile *t)
+{
+    uint64_t map[4];
+    uint64_t in[4];
+    unsigned int a0, na, b0, nb;
+    tile_span(t, &a0, &na, &b0, &nb);
+    data_children(0, 0, map);
+    map_range(map, a0, na, in);
+    if (!(in[0] | in[1] | in[2] | in[3]))
+	return 0;
+    if (t->level >= 4)
+	return 1;
+    data_children(t->ip, 8, map);
+    map_range(map, b0, nb, in);
+    return 0 != (in[0] | in[1] | in[2] | in[3]);
+}
+
+/*
+ * Copy the page for the /24 'ip', with the decay of its cells to file
+ * time 'now' in *decay.  Returns 0 if nothing is stored there.
+ */
+static int
+page_fetch(unsigned int ip, double now, DATA_TYPE *D, uint64_t cells[4], double *decay)
+{
+    data_meta *m;
+    DATA_TYPE *P = data_page(ip, &m);
+    double stamp;
+    if (0 == P || !m->live)
+	return 0;
+    data_read(P, m, D, cells, &stamp);
+    *decay = decay_factor(now - stamp);
+    return 1;
+}
+
+/*
+ * Draw a page copied by page_fetch() into 't', each texel keeping the
+ * larger of what it holds and the cells under it, decayed to the tile's
+ * epoch, and the third octet of the /24 the larger came from.  Cells
+ * whose coordinates fall outside the tile, such as addresses outside the
+ * crop bounds, are skipped.
+ */
+static void
+tile_merge(tile *t, unsigned int ip, const DATA_TYPE *D, const uint64_t cells[4], double decay, double now)
+{
+    double rise = 1.0 / decay_factor(now - t->epoch);
+    unsigned int side = TILE_SIZE << t->level;
+    unsigned int x[256], y[256];
+    unsigned int d, j = 0;
+    xy_from_ip_block(ip, cells, x, y);
+    DATA_FOREACH(cells, d) {
+	unsigned int dx = x[j] - t->x0;
+	unsigned int dy = y[j] - t->y0;
+	double v = DATA_VALUE(D[d]) * decay;
+	float u = v * rise;
+	unsigned int k;
+	j++;
+	if (v < FLOOR || dx >= side || dy >= side)
+	    continue;
+	k = (dy >> t->level) * TILE_SIZE + (dx >> t->level);
+	if (u > t->u[k]) {
+	    t->u[k] = u;
+	    t->owner[k] = (ip >> 8) & 0xFF;
+	}
+	t->lit = 1;
+    }
+}
+
+/*
+ * Note that texels 'x' to 'x + w - 1' by 'y' to 'y + w - 1' need uploading
+ */
+static void
+tile_touch(tile *t, unsigned int x, unsigned int y, unsigned int w)
+{
+    if (x < t->lo_x)
+	t->lo_x = x;
+    if (y < t->lo_y)
+	t->lo_y = y;
+    if (x + w > t->hi_x)
+	t->hi_x = x + w;
+    if (y + w > t->hi_y)
+	t->hi_y = y + w;
+}
+
+/*
+ * Rasterize the counters under 't', decayed to file time 'now'
+ */
+static void
+tile_build(tile *t, double now)
+{
+    uint64_t slash8[4], slash16[4], slash24[4], all[4];
+    unsigned int a0, na, b0, nb;
+    unsigned int a, b, c;
+    tile_span(t, &a0, &na, &b0, &nb);
+    memset(t->u, 0, TILE_SIZE * TILE_SIZE * sizeof(*t->u));
+    memset(t->owner, 0, TILE_SIZE * TILE_SIZE);
+    t->lit = 0;
+    t->epoch = now;
+    t->gen = GEN;
+    t->block_frame = 0;
+    data_children(0, 0, all);
+    map_range(all, a0, na, slash8);
+    DATA_FOREACH(slash8, a) {
+	data_children(a << 24, 8, all);
+	map_range(all, b0, nb, slash16);
+	DATA_FOREACH(slash16, b) {
+	    data_children((a << 24) | (b << 16), 16, slash24);
+	    DATA_FOREACH(slash24, c) {
+		unsigned int ip = (a << 24) | (b << 16) | (c << 8);
+		DATA_TYPE D[256];
+		uint64_t cells[4];
+		double decay;
+		if (page_fetch(ip, now, D, cells, &decay))
+		    tile_merge(t, ip, D, cells, decay, now);
+	    }
+	}
+    }
+    tile_touch(t, 0, 0, TILE_SIZE);
+}
+
+/*
+ * Move a tile's epoch up to 'now' once its texels have decayed enough
+ * that float precision would start to suffer
+ */
+static void
+tile_rebase(tile *t, double now)
+{
+    float f = decay_factor(now - t->epoch);
+    unsigned int k;
+    if (f > TILE_REBASE)
+	return;
+    for (k = 0; k < TILE_SIZE * TILE_SIZE; k++)
+	t->u[k] *= f;
+    t->epoch = now;
+    tile_touch(t, 0, 0, TILE_SIZE);
+}
+
+/*
+ * Send the texels changed since the last upload to the texture
+ */
+static void
+tile_upload(tile *t)
+{
+    if (t->lo_x >= t->hi_x)
+	return;
+    glBindTexture(GL_TEXTURE_2D, t->tex);
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, TILE_SIZE);
+    glPixelStorei(GL_UNPACK_SKIP_PIXELS, t->lo_x);
+    glPixelStorei(GL_UNPACK_SKIP_ROWS, t->lo_y);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, t->lo_x, t->lo_y, t->hi_x - t->lo_x, t->hi_y - t->lo_y, GL_RED, GL_FLOAT, t->u);
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+    glPixelStorei(GL_UNPACK_SKIP_PIXELS, 0);
+    glPixelStorei(GL_UNPACK_SKIP_ROWS, 0);
+    t->lo_x = t->lo_y = TILE_SIZE;
+    t->hi_x = t->hi_y = 0;
+}
+
+/*
+ * Redraw the /24 containing 'i' in every cached tile over it, at file
+ * time 'now'.  Below level 4 that is a square of texels holding nothing
+ * else.  From level 4 up it is part of one texel, which only has to be
+ * redrawn from every /24 under it if this one held its maximum and has
+ * gone down; otherwise the texel keeps the larger of the two.  The
+ * caller must be online for reading DATA.
+ */
+void
+tiles_update(unsigned int i, double now)
+{
+    DATA_TYPE D[256];
+    uint64_t cells[4];
+    double decay = 1.0;
+    double top = 0.0;
+    unsigned int c = (i >> 8) & 0xFF;
+    unsigned int x, y, d;
+    int found;
+    int L;
+    i &= ~0xFFu;
+    found = page_fetch(i, now, D, cells, &decay);
+    if (found) {
+	DATA_FOREACH(cells, d) {
+	    double v = DATA_VALUE(D[d]) * decay;
+	    if (v >= FLOOR && v > top)
+		top = v;
+	}
+    }
+    if (!xy_from_ip(i, &x, &y))
+	return;
+    x &= ~15u;
+    y &= ~15u;
+    for (L = 0; L < TILES_LEVELS; L++) {
+	unsigned int side = TILE_SIZE << L;
+	unsigned int n = TILE_SIZE >> L;
+	unsigned int block = i & (~0u << 2 * L);
+	unsigned int tx, ty, k, r;
+	uint64_t all[4], slash24[4];
+	float u;
+	tile *t = TILES[BASE[L] + (y / side) * n + x / side];
+	if (0 == t)
+	    continue;
+	tx = (x - t->x0) >> L;
+	ty = (y - t->y0) >> L;
+	if (L < 4) {
+	    for (r = 0; r < (16u >> L); r++)
+		memset(t->u + (ty + r) * TILE_SIZE + tx, 0, (16 >> L) * sizeof(*t->u));
+	    if (found)
+		tile_merge(t, i, D, cells, decay, now);
+	    tile_touch(t, tx, ty, 16 >> L);
+	    continue;
+	}
+	/* already redrawn from scratch this frame */
+	if (t->block_frame == FRAME && t->block == block)
+	    continue;
+	k = ty * TILE_SIZE + tx;
+	u = top * (1.0 / decay_factor(now - t->epoch));
+	if (u > t->u[k]) {
+	    t->u[k] = u;
+	    t->owner[k] = c;
+	    t->lit = 1;
+	} else if (u == t->u[k] || t->owner[k] != c) {
+	    continue;
+	} else {
+	    t->u[k] = 0;
+	    data_children(block, 16, all);
+	    map_range(all, (block >> 8) & 0xFF, 1u << (2 * L - 8), slash24);
+	    DATA_FOREACH(slash24, r) {
+		unsigned int ip = (block & ~0xFFFFu) | (r << 8);
+		DATA_TYPE E[256];
+		uint64_t ecells[4];
+		double edecay;
+		if (page_fetch(ip, now, E, ecells, &edecay))
+		    tile_merge(t, ip, E, ecells, edecay, now);
+	    }
+	    t->block = block;
+	    t->block_frame = FRAME;
+	}
+	tile_touch(t, tx, ty, 1);
+    }
+}
+
+/*
+ * A cache entry for slot 'slot'.  Once the cache holds TILE_MAX tiles the
+ * one drawn longest ago is reused, unless every tile is in this frame.
+ */
+static tile *
+tile_new(unsigned int slot)
+{
+    tile *t = 0;
+    unsigned int k;
+    if (NCACHE >= TILE_MAX) {
+	for (k = 0; k < NCACHE; k++)
+	    if (CACHE[k]->drawn != FRAME && (0 == t || CACHE[k]->drawn < t->drawn))
+		t = CACHE[k];
+    }
+    if (t) {
+	TILES[t->slot] = 0;
+    } else {
+	if (NCACHE == CACHE_SIZE) {
+	    CACHE_SIZE = CACHE_SIZE ? 2 * CACHE_SIZE : TILE_MAX;
+	    if (0 == (CACHE = realloc(CACHE, CACHE_SIZE * sizeof(*CACHE))))
+		err(1, "realloc");
+	}
+	if (0 == (t = calloc(1, sizeof(*t))))
+	    err(1, "calloc");
+	if (0 == (t->u = malloc(TILE_SIZE * TILE_SIZE * sizeof(*t->u))))
+	    err(1, "malloc");
+	if (0 == (t->owner = malloc(TILE_SIZE * TILE_SIZE)))
+	    err(1, "malloc");
+	glGenTextures(1, &t->tex);
+	glBindTexture(GL_TEXTURE_2D, t->tex);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, TILE_SIZE, TILE_SIZE, 0, GL_RED, GL_FLOAT, 0);
+	CACHE[NCACHE++] = t;
+    }
+    t->slot = slot;
+    TILES[slot] = t;
+    return t;
+}
+
+/*
+ * Draw the tiles covering 'window' (in map units) at the level suited to
+ * a scale of 'pixels_per_unit', building them as needed.
+ * The caller must be online for reading DATA.
+ */
+void
+tiles_draw(bbox window, double pixels_per_unit, double now)
+{
+    unsigned int nstale = 0;
+    unsigned int n, side;
+    unsigned int tx0, tx1, ty0, ty1, tx, ty;
+    unsigned int k;
+    double start = wall_time();
+    int rebuilt = 0;
+    int L;
+    for (L = 0; L < TILES_LEVELS - 1 && (1 << L) * pixels_per_unit < 1.0; L++)
+	;
+    LEVEL = L;
+    n = (TILE_SIZE >> L);
+    side = TILE_SIZE << L;
+    tx0 = window.xmin > 0 ? window.xmin / side : 0;
+    ty0 = window.ymin > 0 ? window.ymin / side : 0;
+    tx1 = window.xmax > 0 ? window.xmax / side : 0;
+    ty1 = window.ymax > 0 ? window.ymax / side : 0;
+    if (tx1 >= n)
+	tx1 = n - 1;
+    if (ty1 >= n)
+	ty1 = n - 1;
+    FRAME++;
+    NDRAWN = 0;
+
+    glUseProgram(PROGRAM);
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_1D, points_colormap());
+    glActiveTexture(GL_TEXTURE0);
+    for (ty = ty0; ty <= ty1; ty++) {
+	for (tx = tx0; tx <= tx1; tx++) {
+	    unsigned int slot = BASE[L] + ty * n + tx;
+	    tile *t = TILES[slot];
+	    tile probe;
+	    if (0 == t) {
+		probe.level = L;
+		probe.x0 = tx * side;
+		probe.y0 = ty * side;
+		ip_from_xy(probe.x0, probe.y0, &probe.ip);
+		if (L < 8)
+		    probe.ip &= ~0u << (16 + 2 * L);
+		else
+		    probe.ip = 0;
+		if (!tile_occupied(&probe))
+		    continue;
+		t = tile_new(slot);
+		t->level = probe.level;
+		t->x0 = probe.x0;
+		t->y0 = probe.y0;
+		t->ip = probe.ip;
+		t->drawn = FRAME;
+		tile_build(t, now);
+	    } else if (t->gen != GEN) {
+		nstale++;
+	    }
+	    t->drawn = FRAME;
+	}
+    }
+    /* rebuild the stalest first, and at least one */
+    while (nstale && (!rebuilt || wall_time() - start < TILE_BUDGET)) {
+	tile *oldest = 0;
+	for (k = 0; k < NCACHE; k++) {
+	    tile *t = CACHE[k];
+	    if (t->drawn == FRAME && t->gen != GEN && (0 == oldest || t->gen < oldest->gen))
+		oldest = t;
+	}
+	tile_build(oldest, now);
+	nstale--;
+	rebuilt = 1;
+    }
+    for (k = 0; k < NCACHE; k++) {
+	tile *t = CACHE[k];
+	if (t->drawn != FRAME || !t->lit)
+	    continue;
+	tile_rebase(t, now);
+	tile_upload(t);
+	glBindTexture(GL_TEXTURE_2D, t->tex);
+	glUniform1f(U_DECAY, decay_factor(now - t->epoch));
+	/* a point used to be centered on its address's coordinates */
+	glBegin(GL_QUADS);
+	glTexCoord2f(0, 0);
+	glVertex2f(t->x0 - 0.5, t->y0 - 0.5);
+	glTexCoord2f(1, 0);
+	glVertex2f(t->x0 + side - 0.5, t->y0 - 0.5);
+	glTexCoord2f(1, 1);
+	glVertex2f(t->x0 + side - 0.5, t->y0 + side - 0.5);
+	glTexCoord2f(0, 1);
+	glVertex2f(t->x0 - 0.5, t->y0 + side - 0.5);
+	glEnd();
+	NDRAWN++;
+    }
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_1D, 0);
+    glActiveTexture(GL_TEXTURE0);
+    glUseProgram(0);
+}
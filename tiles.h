@@ -0,0 +1,19 @@
+#ifndef TILES_H
+#define TILES_H
+
+#include "bbox.h"
+
+/*
+ * The map as a pyramid of 256x256 texture tiles.  Level 0 has a texel
+ * per address and a tile per /16; each level up halves the resolution,
+ * so a level 4 tile is a /8 and level 8 is the whole map in one tile.
+ */
+#define TILES_LEVELS 9
+
+int tiles_init(double floor);
+void tiles_update(unsigned int i, double now);
+void tiles_draw(bbox window, double pixels_per_unit, double now);
+void tiles_invalidate(void);
+void tiles_stats(unsigned int *ntiles, int *level);
+
+#endif
@@ -6,6 +6,7 @@
  */
 
 #include <stdio.h>
+#include <stdint.h>
 #include <err.h>
 
 #include <sys/types.h>
@@ -16,11 +17,16 @@
 #include "cidr.h"
 
 
+extern void hil_init(void);
 extern void hil_xy_from_s(unsigned s, int n, unsigned *xp, unsigned *yp);
+extern unsigned hil_xy_from_s_block(unsigned s, int n, const uint64_t cells[4], unsigned *xp, unsigned *yp);
 extern void hil_s_from_xy(unsigned x, unsigned y, int order, unsigned *s);
+extern void mor_init(void);
 extern void mor_xy_from_s(unsigned s, int n, unsigned *xp, unsigned *yp);
+extern unsigned mor_xy_from_s_block(unsigned s, int n, const uint64_t cells[4], unsigned *xp, unsigned *yp);
 extern void mor_s_from_xy(unsigned x, unsigned y, int order, unsigned *s);
 void (*xy_from_s) (unsigned s, int n, unsigned *xp, unsigned *yp) = hil_xy_from_s;
+unsigned (*xy_from_s_block) (unsigned s, int n, const uint64_t cells[4], unsigned *xp, unsigned *yp) = hil_xy_from_s_block;
 void (*s_from_xy) (unsigned x, unsigned y, int order, unsigned *s) = hil_s_from_xy;
 
 extern int DEBUG;
@@ -36,6 +42,13 @@ static int addr_space_bits_per_pixel = 8;	/* /24 */
 unsigned int addr_space_first_addr = 0;
 unsigned int addr_space_last_addr = ~0;
 
+/*
+ * Added to the first address of a prefix with an even number of bits,
+ * gives the address in the opposite corner of its square: binary 10 at
+ * every level of the Hilbert curve, 11 on the Morton curve.
+ */
+unsigned int curve_diagonal = 0xAAAAAAAA;
+
 
 /*
  * Translate an IPv4 address (stored as a 32bit int) into
@@ -51,10 +64,42 @@ xy_from_ip(unsigned ip, unsigned *xp, unsigned *yp)
     if (ip > addr_space_last_addr)
 	return 0;
     s = (ip - addr_space_first_addr) >> addr_space_bits_per_pixel;
-    xy_from_s(s, hilbert_curve_order, xp, yp);
+    /* a direct call, not through the pointer, for the usual curve */
+    if (hil_xy_from_s == xy_from_s)
+	hil_xy_from_s(s, hilbert_curve_order, xp, yp);
+    else
+	xy_from_s(s, hilbert_curve_order, xp, yp);
     return 1;
 }
 
+/*
+ * Translate the addresses of the /24 containing 'ip' whose last octets
+ * are set in 'cells' into xp[] and yp[], in order, and return how many
+ * there were.  When each address is a pixel, the whole /24 shares its
+ * path down the curve to the last four levels, so that part is only
+ * worked out once.  An address outside the crop bounds is given ~0u for
+ * both coordinates, which is off the map, so that the results still line
+ * up with the cells.
+ */
+unsigned int
+xy_from_ip_block(unsigned ip, const uint64_t cells[4], unsigned *xp, unsigned *yp)
+{
+    unsigned int n = 0;
+    unsigned int k;
+    ip &= ~0xFFu;
+    if (0 == addr_space_bits_per_pixel && hilbert_curve_order >= 4 &&
+	0 == (addr_space_first_addr & 0xFF) && ip >= addr_space_first_addr && (ip | 0xFF) <= addr_space_last_addr)
+	return xy_from_s_block(ip - addr_space_first_addr, hilbert_curve_order, cells, xp, yp);
+    for (k = 0; k < 256; k++) {
+	if (0 == (cells[k >> 6] & (1ull << (k & 63))))
+	    continue;
+	if (!xy_from_ip(ip | k, xp + n, yp + n))
+	    xp[n] = yp[n] = ~0u;
+	n++;
+    }
+    return n;
+}
+
 /*
  * Translate X,Y coordinate into an IPv4 address (stored as
  * a 32bit int)
@@ -62,7 +107,10 @@ xy_from_ip(unsigned ip, unsigned *xp, unsigned *yp)
 unsigned int
 ip_from_xy(unsigned x, unsigned y, unsigned int *ip)
 {
-    s_from_xy(x, y, hilbert_curve_order, ip);
+    if (hil_s_from_xy == s_from_xy)
+	hil_s_from_xy(x, y, hilbert_curve_order, ip);
+    else
+	s_from_xy(x, y, hilbert_curve_order, ip);
     *ip <<= addr_space_bits_per_pixel;
     return 1;
 }
@@ -70,6 +118,7 @@ ip_from_xy(unsigned x, unsigned y, unsigned int *ip)
 int
 set_order()
 {
+    hil_init();
     hilbert_curve_order = (addr_space_bits_per_image - addr_space_bits_per_pixel) / 2;
     if (DEBUG) {
 	struct in_addr a;
@@ -96,6 +145,19 @@ set_crop(const char *cidr)
 	errx(1, "Space to render must have even number of CIDR bits");
 }
 
+/*
+ * Lay the addresses out along the Morton (Z-order) curve instead
+ */
+void
+set_morton_mode(void)
+{
+    mor_init();
+    xy_from_s = mor_xy_from_s;
+    xy_from_s_block = mor_xy_from_s_block;
+    s_from_xy = mor_s_from_xy;
+    curve_diagonal = 0xFFFFFFFF;
+}
+
 void
 set_bits_per_pixel(int bpp)
 {